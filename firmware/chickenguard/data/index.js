@@ -6,12 +6,42 @@ var gateway = `ws://${window.location.hostname}/ws`;
 var websocket;
 var currentPosition = { coords: { latitude: 50.85, longitude: 4.35 } }; //Coordinates of Brussels
 
-// Symbolic constants for the door control
+// Motor telemetry, layout must match include/telemetry.h
+const TELEMETRY_FRAME_TYPE_MOTOR = 1;
+const TELEMETRY_HEADER_SIZE = 4;
+const TELEMETRY_SAMPLE_SIZE = 10;
+const TELEMETRY_PLOT_WINDOW = 400; // samples : 20s at 20Hz
+const MotorStates = ["Off", "Start raise", "Start lower", "Dead time", "Pulling loose rope", "Running"];
+var motorSamples = [];
+
+// Profiler statistics, layout must match include/profiler.h
+const PROFILE_FRAME_TYPE = 2;
+const PROFILE_HEADER_SIZE = 4;
+const PROFILE_HISTOGRAM_BUCKETS = 24;
+const PROFILE_SECTION_SIZE = 16 + 2 * PROFILE_HISTOGRAM_BUCKETS;
+const ProfileSections = ["Motor run", "RTC poll", "Button sample", "Battery check", "Webserver loop", "Event handlers"];
+
+// Binary messages, layout must match include/wsProtocol.h
+const PROTOCOL_VERSION = 1;
+const CONFIG_MESSAGE_TYPE = 3;
+const CONFIG_MESSAGE_SIZE = 51;
+const STATUS_MESSAGE_TYPE = 4;
+const STATUS_MESSAGE_SIZE = 12;
+const HELLO_MESSAGE_TYPE = 5;
+const TIME_ZONE_SIZE = 32;
+
+// Event log, values must match include/eventLog.h and MotorControl::StopReason
+const EVENT_LOG_PAGE_SIZE = 10;
+const EventSources = ["Alarm", "Button", "Console"];
+const StopReasons = ["None", "End position", "Overload", "Timeout", "No current"];
+var eventLogPage = 0;
+var eventLogTotal = 0;
+
+// Door control, values must match NonVolatileStorage::DoorControl
 const DoorControl = Object.freeze({
-    //Symbol description must match the one in the ESP32
-    manualcontrol: Symbol("manual"),
-    fixedTimeControl: Symbol("fixedTime"),
-    sunControl: Symbol("sun"),
+    manualcontrol: 0,
+    fixedTimeControl: 1,
+    sunControl: 2,
 })
 
 
@@ -28,6 +58,8 @@ window.addEventListener("unload", function () {
 function onLoad(event) {
     initWebSocket();
     document.getElementById('submit').addEventListener('click', onSubmit);
+    document.getElementById('eventLogNewer').addEventListener('click', () => requestEventLogPage(eventLogPage - 1));
+    document.getElementById('eventLogOlder').addEventListener('click', () => requestEventLogPage(eventLogPage + 1));
     document.getElementById("manuallyId").checked = true;
 
     // Only enable the sun button after the geolocation is available
@@ -61,6 +93,7 @@ function onLoad(event) {
 function initWebSocket() {
     console.log('Trying to open a WebSocket connection...');
     websocket = new WebSocket(gateway);
+    websocket.binaryType = 'arraybuffer';
     websocket.onopen = onOpen;
     websocket.onclose = onClose;
     websocket.onmessage = onMessage;
@@ -68,9 +101,16 @@ function initWebSocket() {
 
 function onOpen(event) {
     console.log('Connection opened');
+    // Ask for binary status messages
+    websocket.send(new Uint8Array([HELLO_MESSAGE_TYPE, PROTOCOL_VERSION]));
+    requestEventLogPage(0);
 }
 
 function onMessage(event) {
+    if (event.data instanceof ArrayBuffer) {
+        onBinaryMessage(new DataView(event.data));
+        return;
+    }
     let data = JSON.parse(event.data);
     console.log(data);
     switch(data.key)
@@ -81,9 +121,123 @@ function onMessage(event) {
         case 'battery':
             document.getElementById('battery').innerHTML = String(data.status);
             break;
+        case 'heap':
+            document.getElementById('heap').innerHTML = String(data.status);
+            break;
+        case 'eventlog':
+            onEventLog(data);
+            break;
+    }
+}
+
+function onBinaryMessage(view) {
+    if (view.byteLength >= TELEMETRY_HEADER_SIZE && view.getUint8(0) == TELEMETRY_FRAME_TYPE_MOTOR) {
+        onMotorTelemetry(view);
+    } else if (view.byteLength >= PROFILE_HEADER_SIZE && view.getUint8(0) == PROFILE_FRAME_TYPE) {
+        onProfile(view);
+    } else if (view.byteLength == STATUS_MESSAGE_SIZE && view.getUint8(0) == STATUS_MESSAGE_TYPE && view.getUint8(1) == PROTOCOL_VERSION) {
+        onStatus(view);
+    } else {
+        console.error("Unknown binary message");
+    }
+}
+
+function onStatus(view) {
+    document.getElementById('battery').innerHTML = view.getUint8(2) + "%";
+    document.getElementById('heap').innerHTML = view.getUint32(4, true) + " bytes free, largest block " + view.getUint32(8, true);
+}
+
+function onMotorTelemetry(view) {
+    let count = view.getUint8(2);
+    for (let i = 0; i < count; i++) {
+        let offset = TELEMETRY_HEADER_SIZE + i * TELEMETRY_SAMPLE_SIZE;
+        if (offset + TELEMETRY_SAMPLE_SIZE > view.byteLength) break;
+        let sample = {
+            time: view.getUint16(offset, true),
+            rawCurrent: view.getUint16(offset + 2, true),
+            current: view.getUint16(offset + 4, true),
+            voltage: view.getUint16(offset + 6, true),
+            state: view.getUint8(offset + 8),
+        };
+        if (motorSamples.length > 0 && sample.time < motorSamples[motorSamples.length - 1].time) {
+            // New motor run
+            motorSamples = [];
+        }
+        motorSamples.push(sample);
+    }
+    if (motorSamples.length > TELEMETRY_PLOT_WINDOW) {
+        motorSamples.splice(0, motorSamples.length - TELEMETRY_PLOT_WINDOW);
+    }
+    document.getElementById("motorTelemetry").classList.remove("hide");
+    let last = motorSamples[motorSamples.length - 1];
+    if (last) {
+        document.getElementById('motorState').innerHTML = (MotorStates[last.state] || last.state) + ", " + last.voltage + "mV";
+    }
+    plotMotorSamples();
+}
+
+// One row per section : times in µs, histogram as the number of executions per power of two of cycles
+function onProfile(view) {
+    let frequency = view.getUint8(3);
+    let rows = "<tr><th>Section</th><th>Count</th><th>Min</th><th>Avg</th><th>Max</th><th>Histogram</th></tr>";
+    for (let i = 0; i < view.getUint8(2); i++) {
+        let offset = PROFILE_HEADER_SIZE + i * PROFILE_SECTION_SIZE;
+        if (offset + PROFILE_SECTION_SIZE > view.byteLength) break;
+        let values = [0, 1, 2, 3].map(j => view.getUint32(offset + 4 * j, true));
+        let histogram = [];
+        for (let j = 0; j < PROFILE_HISTOGRAM_BUCKETS; j++) {
+            let count = view.getUint16(offset + 16 + 2 * j, true);
+            if (count > 0) histogram.push("2^" + j + ":" + count);
+        }
+        rows += "<tr><td>" + (ProfileSections[i] || i) + "</td><td>" + values[0] + "</td>"
+            + values.slice(1).map(cycles => "<td>" + (cycles / frequency).toFixed(1) + "</td>").join("")
+            + "<td>" + histogram.join(" ") + "</td></tr>";
+    }
+    document.getElementById("profileTable").innerHTML = rows;
+    document.getElementById("profiler").classList.remove("hide");
+}
+
+function requestEventLogPage(page) {
+    if (page < 0 || (page > 0 && page * EVENT_LOG_PAGE_SIZE >= eventLogTotal)) return;
+    if (websocket.readyState == WebSocket.OPEN) {
+        websocket.send(JSON.stringify({ 'EventLogPage': page }));
     }
 }
 
+// One row per motor run, newest first
+function onEventLog(data) {
+    eventLogPage = data.page;
+    eventLogTotal = data.total;
+    let rows = "<tr><th>Time</th><th>Door</th><th>Source</th><th>Stop</th><th>Peak</th><th>Battery [mV]</th><th>Travel [s]</th></tr>";
+    for (let run of data.records) {
+        rows += "<tr><td>" + new Date(run[0] * 1000).toLocaleString() + "</td><td>" + (run[2] ? "Open" : "Close") + "</td><td>"
+            + (EventSources[run[1]] || run[1]) + "</td><td>" + (StopReasons[run[3]] || run[3]) + "</td><td>" + run[4] + "</td><td>"
+            + run[5] + "</td><td>" + (run[6] / 10).toFixed(1) + "</td></tr>";
+    }
+    document.getElementById("eventLogTable").innerHTML = rows;
+    let pages = Math.max(1, Math.ceil(eventLogTotal / EVENT_LOG_PAGE_SIZE));
+    document.getElementById("eventLogPage").innerHTML = (eventLogPage + 1) + " / " + pages;
+}
+
+// Raw current in grey, filtered current in black.  Vertical scale : full ADC range.
+function plotMotorSamples() {
+    let canvas = document.getElementById("motorPlot");
+    let ctx = canvas.getContext("2d");
+    ctx.clearRect(0, 0, canvas.width, canvas.height);
+    const plotLine = (key, color) => {
+        ctx.strokeStyle = color;
+        ctx.beginPath();
+        motorSamples.forEach((sample, i) => {
+            let x = i * canvas.width / TELEMETRY_PLOT_WINDOW;
+            let y = canvas.height - sample[key] * canvas.height / 4096;
+            if (i == 0) ctx.moveTo(x, y); else ctx.lineTo(x, y);
+        });
+        ctx.stroke();
+    };
+    plotLine("rawCurrent", "#bbb");
+    plotLine("current", "black");
+}
+
 function onClose(event) {
     console.log('Connection closed');
     setTimeout(initWebSocket, 2000);
@@ -105,27 +259,40 @@ function onSubmit(event) {
             console.error("Unknown door control value: " + document.querySelector('input[name="doorcontrol"]:checked').value);
     }
 
-    let jsonstring = JSON.stringify(
-        {
-            'UTCSeconds': Math.floor(Date.now() / 1000),
-            'Timezone' : Intl.DateTimeFormat().resolvedOptions().timeZone, 
-            'Latitude': currentPosition.coords.latitude,
-            'Longitude': currentPosition.coords.longitude,
-            'DoorControl': doorControlValue.description,
-            'AutomaticOpeningTime': document.getElementById("AutomaticOpeningTime").value,
-            'AutomaticClosingTime': document.getElementById("AutomaticClosingTime").value,   
-        }
-    )
-    console.log(jsonstring);
+    let message = encodeConfig(doorControlValue,
+        document.getElementById("AutomaticOpeningTime").value,
+        document.getElementById("AutomaticClosingTime").value);
     document.getElementById("serverFeedback").classList.remove("hide");
     document.getElementById("modeSelection").classList.add("hide");
     document.getElementById("submitbutton").classList.add("hide");
     document.getElementById("fixed_time_door_timings").classList.add("hide");
     if (websocket.readyState == WebSocket.OPEN) {
-        websocket.send(jsonstring);
+        websocket.send(message);
     }
 }
 
+// Times as "hh:mm" in local time
+function encodeConfig(doorControl, openingTime, closingTime) {
+    let buffer = new ArrayBuffer(CONFIG_MESSAGE_SIZE);
+    let view = new DataView(buffer);
+    let [openHour, openMinute] = openingTime.split(":").map(Number);
+    let [closeHour, closeMinute] = closingTime.split(":").map(Number);
+    view.setUint8(0, CONFIG_MESSAGE_TYPE);
+    view.setUint8(1, PROTOCOL_VERSION);
+    view.setUint8(2, doorControl);
+    view.setUint8(3, openHour);
+    view.setUint8(4, openMinute);
+    view.setUint8(5, closeHour);
+    view.setUint8(6, closeMinute);
+    view.setInt32(7, Math.floor(Date.now() / 1000), true);
+    view.setFloat32(11, currentPosition.coords.latitude, true);
+    view.setFloat32(15, currentPosition.coords.longitude, true);
+    // Zero padded, the ESP32 truncates a longer name
+    let timeZone = new TextEncoder().encode(Intl.DateTimeFormat().resolvedOptions().timeZone);
+    new Uint8Array(buffer, 19, TIME_ZONE_SIZE).set(timeZone.subarray(0, TIME_ZONE_SIZE - 1));
+    return buffer;
+}
+
 // ----------------------------------------------------------------------------
 // Time handling
 // ----------------------------------------------------------------------------
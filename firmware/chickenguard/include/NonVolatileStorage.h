@@ -1,6 +1,21 @@
 #pragma once
 #include "Preferences.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
+/**
+ * @brief Door settings in NVS, restored on demand.
+ * @details A setting is only read from NVS by the first call that needs it, later calls use the cached value.  The NVS handle is
+ * opened at the first access and kept open.  The settings are stored as two entries :
+ *  - door control, fixed times and location : a small versioned blob with a CRC32.  The alarm path needs the door control and
+ *    either the times or the location, one read of the blob is cheaper than a lookup per field.
+ *  - time zone : a string, only needed for local time conversions.
+ * saveAll() only writes the entries that have changed, so a config session that doesn't change anything doesn't wear the flash.
+ * The per-key settings of older firmware are migrated at the first access.
+ * The door state is stored under its own key, because it changes with every motor run while the settings hardly ever change.
+ * The scheduler, network and console tasks all use the settings : the public functions are serialized by a mutex, the private
+ * ones must be called with the mutex taken.
+ */
 class NonVolatileStorage
 {
 public:
@@ -10,31 +25,98 @@ public:
         FixTime,
         SunriseSunset
     };
+    enum class DoorPosition
+    {
+        Unknown,
+        Open,
+        Closed
+    };
+    enum class DoorConfidence
+    {
+        None,      //!< The position is unknown
+        Started,   //!< A run towards the position has been started, but it hasn't ended yet
+        Assumed,   //!< The last run ended without detecting the end position, e.g. timeout
+        Confirmed  //!< The last run ended at the end position
+    };
+    struct __attribute__((packed)) DoorState
+    {
+        uint8_t position;   //!< DoorPosition
+        uint8_t confidence; //!< DoorConfidence
+        uint32_t utc;       //!< Time of the last change
+        DoorPosition getPosition() const { return static_cast<DoorPosition>(position); }
+        DoorConfidence getConfidence() const { return static_cast<DoorConfidence>(confidence); }
+    };
+
+    static const size_t MAX_TIME_ZONE_LENGTH = 31; //!< Longest name in the time zone table of TimeControl
+
+    /**
+     * @brief Time taken by the first read of each entry, shown by the console "stats" command.  Instrumentation only : the restore
+     * time of the blob against the per-key settings of older firmware hasn't been measured on the board yet.
+     */
+    struct ReadTimes
+    {
+        uint32_t settings_us;  //!< 0 until read
+        uint32_t timeZone_us;
+        uint32_t doorState_us;
+    };
 
     NonVolatileStorage();
     ~NonVolatileStorage();
-    void restoreAll();
+    bool begin();
     void saveAll();
-    void getGeoLocation(float& latitude, float& longitude) const;
+    void getGeoLocation(float& latitude, float& longitude);
     void setGeoLocation(const float latitude, const float longitude);
-    void getFixOpeningTime(uint8_t& hour, uint8_t& minutes) const;
-    void setFixOpeningTime(const String hour_minutes);
-    void getFixClosingTime(uint8_t& hour, uint8_t& minutes) const;
-    void setFixClosingTime(const String hour_minutes);
-    DoorControl getDoorControl() const;
-    void setDoorControl(const String doorControl);
-    void setTimeZone(const String timeZone);
-    String getTimeZone() const;
+    void getFixOpeningTime(uint8_t& hour, uint8_t& minutes);
+    void setFixOpeningTime(uint8_t hour, uint8_t minutes);
+    void getFixClosingTime(uint8_t& hour, uint8_t& minutes);
+    void setFixClosingTime(uint8_t hour, uint8_t minutes);
+    DoorControl getDoorControl();
+    void setDoorControl(DoorControl doorControl);
+    void setTimeZone(const char *timeZone);
+    const char *getTimeZone();
+    uint32_t getWriteCount() const { return _writeCount; }
+    const ReadTimes &getReadTimes() const { return _readTimes; }
+    void restoreDoorState();
+    DoorState getDoorState();
+    void setDoorState(DoorPosition position, DoorConfidence confidence);
+    static bool parseTimeString(const char *hour_minutes, uint8_t& hour, uint8_t& minutes);
+    static bool parseDoorControl(const char *name, DoorControl& doorControl);
 
 private:
-    bool parseTimeString(const String hour_minutes, uint8_t& hour, uint8_t& minutes);
+    struct __attribute__((packed)) Blob
+    {
+        uint8_t version;
+        uint8_t doorControl;
+        uint8_t fixOpeningTime_hour;
+        uint8_t fixOpeningTime_minute;
+        uint8_t fixClosingTime_hour;
+        uint8_t fixClosingTime_minute;
+        float latitude;
+        float longitude;
+        uint32_t crc; //!< CRC32 of all preceding bytes
+    };
+    bool open();
+    void restoreSettings();
+    void save();
+    void restoreTimeZone();
+    void toBlob(Blob &blob) const;
+    void fromBlob(const Blob &blob);
+    bool restoreBlob();
+    void migrateKeys();
+    static uint32_t crc(const Blob &blob);
 
     //Wrapper functions prevent crashes when key is not present (in the event of a new firmware that has extra parameters)
     float getFloat(const char* key, const float defaultValue);
     uint8_t getUChar(const char* key, const uint8_t defaultValue);
-    String getString(const char* key, const String defaultValue);
+    void getString(const char* key, char* value, size_t size, const char* defaultValue);
 
+    SemaphoreHandle_t _mutex = nullptr;
+    StaticSemaphore_t _mutexBuffer;
     Preferences _preferences;
+    bool _opened = false;
+    bool _settingsRestored = false;
+    bool _timeZoneRestored = false;
+    bool _timeZoneChanged = false;
     float _latitude = 0;
     float _longitude = 0;
     uint8_t _fixOpeningTime_hour = 0;
@@ -42,5 +124,10 @@ private:
     uint8_t _fixClosingTime_hour = 0;
     uint8_t _fixClosingTime_minute = 0;
     DoorControl _doorControl = DoorControl::Manual;
-    String _timeZone = "";
+    char _timeZone[MAX_TIME_ZONE_LENGTH + 1] = "";
+    Blob _stored;              //!< Copy of the blob in NVS, to detect changes without reading the flash
+    bool _storedValid = false;
+    uint32_t _writeCount = 0;  //!< Number of NVS writes since boot
+    ReadTimes _readTimes = {};
+    DoorState _doorState = {};
 };
\ No newline at end of file
@@ -3,26 +3,75 @@
 #include <Arduino.h>
 #include <DNSServer.h>
 #include <ESPAsyncWebServer.h>
-#include "NonVolatileStorage.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "eventLog.h"
+#include "wsProtocol.h"
+#include "wsReassembler.h"
 
 class Webservice
 {
 public:
-    Webservice(NonVolatileStorage* nonVolatileStorage, void (*updateTime)(long utc, const String timezone), void (*cbDataReceived)(void));
+    Webservice(EventLog* eventLog, bool (*configReceived)(const WsProtocol::Config &config), void (*printStatus)(Print &output));
     ~Webservice();
     void setup();
+    void stop();
     void loop();
-    void notifyClients(String key, String status);
-    void handleWebSocketMessage(void *arg, uint8_t *data, size_t len);
+    void notifyClients(const char *key, const char *status);
+    void publishStatus(uint8_t batteryPercent, uint32_t freeHeap, uint32_t largestBlock);
+    bool sendBinary(const uint8_t *data, size_t len);
+    bool isActive() const { return isInitialized; }
+    void printStatus(Print &output) { _printStatus(output); }
+    void handleWebSocketMessage(uint32_t clientId, void *arg, uint8_t *data, size_t len);
+    void onClientConnected(uint32_t clientId);
+    void onClientDisconnected(uint32_t clientId);
 
 private:
+    static const size_t EVENT_LOG_PAGE_SIZE = 10;
+    static const size_t MAX_CLIENTS = DEFAULT_MAX_WS_CLIENTS;
+    static const unsigned long STATUS_MIN_INTERVAL = 1000; //!< [ms] between two status messages to a client
+    static const uint8_t BATTERY_THRESHOLD = 1;            //!< [%] smaller battery changes aren't published
+    static const uint32_t HEAP_THRESHOLD = 2048;           //!< [bytes] smaller heap changes aren't published
+    enum StatusKey : uint8_t
+    {
+        STATUS_BATTERY = 0x01,
+        STATUS_HEAP = 0x02,
+        STATUS_ALL = STATUS_BATTERY | STATUS_HEAP
+    };
+    struct Client
+    {
+        uint32_t id;           //!< 0 for a free slot, AsyncWebSocket numbers the clients from 1
+        bool binary;           //!< The client has sent Hello, it gets binary status messages
+        uint8_t pendingStatus; //!< StatusKey bits not sent yet : a queue of one, later values replace the pending ones
+        uint32_t lastSent;     //!< [ms] millis() of the last status message to the client
+        WsReassembler reassembler;
+    };
+    void sendEventLogPage(uint32_t clientId, size_t page);
+    void sendFeedback(uint32_t clientId, const char *status);
+    void handleJsonMessage(uint32_t clientId, char *data, size_t len);
+    void handleBinaryMessage(uint32_t clientId, const uint8_t *data, size_t len);
+    void applyConfig(const WsProtocol::Config &config);
+    void flushStatus();
+    Client *findClient(uint32_t clientId);
+    /**
+     * The slots are assigned in the async_tcp task, where AsyncWebSocket calls the event handler, and the status is sent from the
+     * network task.  The mutex guards id, binary, pendingStatus and lastSent.  It's never held while calling AsyncWebSocket, which has
+     * locks of its own.  The reassembler is only used in the async_tcp task.
+     */
+    Client _clients[MAX_CLIENTS] = {};
+    SemaphoreHandle_t _clientsMutex = nullptr;
+    StaticSemaphore_t _clientsMutexBuffer;
+    WsProtocol::Status _status = {}; //!< Last published values
+    bool _statusValid = false;
     const IPAddress localIP;    // the IP address the web server, Samsung requires the IP to be in public space
     const IPAddress subnetMask; // no need to change: https://avinetworks.com/glossary/subnet-mask/
     DNSServer dnsServer;
     AsyncWebServer server; // HTTP port 80
     AsyncWebSocket ws;
     bool isInitialized = false;
-    NonVolatileStorage* _nonVolatileStorage;
-    void (*_cbDataReceived)(void) = nullptr;
-    void (*_updateTime)(long utc, const String timezone) = nullptr;
+    bool _handlersAdded = false; //!< The handlers are kept when the webserver is stopped
+    uint32_t _droppedFrames = 0;
+    EventLog* _eventLog;
+    bool (*_configReceived)(const WsProtocol::Config &config) = nullptr;
+    void (*_printStatus)(Print &output) = nullptr;
 };
\ No newline at end of file
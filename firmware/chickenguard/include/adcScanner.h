@@ -0,0 +1,106 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * @brief Samples all analog inputs with a single continuous (DMA) scan of ADC1.
+ * @details The ESP32-C3 can't mix one-shot reads and the continuous mode on the same ADC, so this is the only module that touches
+ * the ADC.  A task converts the DMA frames and publishes per channel :
+ *  - the latest conversion, updated with every DMA frame (every 10ms)
+ *  - the mean of the conversions during the channel period, so each channel can have its own rate
+ * Both are converted to mV with the eFuse calibration curve.  A channel can have a limit : conversions above it are out of range
+ * and left out, so they don't reach the mean.  Each channel has a single writer slot, protected by a sequence counter,
+ * so consumers never block and never touch the ADC.
+ * Register all channels with addChannel() before calling begin().
+ * The scan can be paused while the firmware is idle : the ADC and its DMA stop and release their power management lock, so the
+ * chip can light-sleep.  The readings keep their last value and the means continue where they were at the next resume().
+ */
+class AdcScanner
+{
+public:
+    struct Reading
+    {
+        uint16_t raw;         //!< Latest conversion
+        uint16_t mV;          //!< Latest conversion, calibrated
+        uint16_t filteredRaw; //!< Mean of the conversions during the last period
+        uint16_t filtered_mV; //!< Mean of the conversions during the last period, calibrated
+        uint32_t count;       //!< Number of periods that have been published, so consumers can detect new values
+    };
+    static const size_t MAX_CHANNELS = 4;
+
+    AdcScanner();
+    ~AdcScanner();
+    bool addChannel(uint8_t pin, uint16_t period_ms, uint16_t maxValid_mV = 0);
+    bool begin();
+    bool pause();
+    bool resume();
+    bool isPaused() const { return _paused; }
+    bool getReading(uint8_t pin, Reading &reading);
+    bool waitForReading(uint8_t pin, Reading &reading, uint32_t timeout_ms);
+
+private:
+    /**
+     * @brief Single writer, multiple reader slot.
+     * @details The sequence is odd while the writer is updating the reading.  A reader retries when the sequence was odd or has
+     * changed while copying.  The writer task has a higher priority than the readers, so a reader can't interrupt a write on the
+     * single core.
+     */
+    class Slot
+    {
+    public:
+        void write(const Reading &reading)
+        {
+            uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+            _sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            _reading = reading;
+            _sequence.store(sequence + 2, std::memory_order_release);
+        }
+        bool read(Reading &reading) const
+        {
+            const int MAX_RETRIES = 4;
+            for (int i = 0; i < MAX_RETRIES; i++)
+            {
+                uint32_t sequence = _sequence.load(std::memory_order_acquire);
+                if (sequence & 1)
+                {
+                    continue;
+                }
+                reading = _reading;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (_sequence.load(std::memory_order_relaxed) == sequence)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        std::atomic<uint32_t> _sequence{0};
+        Reading _reading = {};
+    };
+    struct Channel
+    {
+        uint8_t pin;
+        uint8_t adcChannel;
+        uint16_t period_ms;
+        uint16_t maxValid_mV;      //!< 0 : no limit
+        uint16_t maxValidRaw;      //!< maxValid_mV converted with the calibration curve by begin()
+        uint32_t samplesPerPeriod; //!< Number of conversions per period
+        uint32_t sampleCount;      //!< Conversions in the current period, only used by the writer
+        uint32_t validCount;       //!< Conversions in the current period within the limit, only used by the writer
+        uint32_t sum;              //!< Sum of the valid conversions in the current period, only used by the writer
+        Reading reading;           //!< Writer's copy of the published reading
+        Slot slot;
+    };
+    static void task(void *arg);
+    void processFrame(const uint8_t *data, uint32_t length);
+    static uint16_t maxRaw(uint16_t maxValid_mV);
+    Channel *findChannel(uint8_t pin);
+    Channel _channels[MAX_CHANNELS];
+    size_t _channelCount = 0;
+    bool _running = false;
+    volatile bool _paused = false;
+};
@@ -1,7 +1,21 @@
 #pragma once
 
-#include "AsyncDelay.h"
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "filters.h"
+#include "adcScanner.h"
 
+class EventBus;
+
+/**
+ * @brief Reads the resistor ladder of the buttons in the background.
+ * @details An esp_timer reads the button voltage from the ADC scanner, debounces the button state and posts the button events
+ * on the event bus.
+ * When sleep is allowed and no button has been touched for IDLE_SAMPLES, the timer and the ADC scan are stopped, so that nothing
+ * keeps the chip awake.  A button that pulls the ladder below the logic low level (Down) wakes the sampling up by a GPIO
+ * interrupt, which also wakes the chip from light sleep.  The other buttons stay above that level : they're caught by a short
+ * probe every POLL_PERIOD.
+ */
 class ButtonReader
 {
 public:
@@ -12,15 +26,52 @@ public:
         Up,
         None
     };
-    ButtonReader(const int adcPin);
+    enum class EventType
+    {
+        Pressed,
+        Released,
+        LongPress //!< Button has been held down for LONG_PRESS_TIME, sent once per press
+    };
+    struct Event
+    {
+        EventType type;
+        ButtonSelection button;
+    };
+    ButtonReader(AdcScanner &adc, EventBus &bus, const int adcPin);
     ~ButtonReader();
-    bool update();
-    bool isButtonStateStable() { return _debounceDelay.isExpired(); }
-    ButtonSelection getButton() { return _lastButtonState; }
+    bool begin();
+    void setSleepAllowed(bool allowed);
+    bool isButtonStateStable() const { return _stable; }
+    ButtonSelection getButton() const { return _lastButtonState; }
+    static const uint16_t ADC_PERIOD = 10;              //!< [ms] same as the sample period
 private:
+    static const uint64_t SAMPLE_PERIOD_us = ADC_PERIOD * 1000;
+    static const uint32_t DEBOUNCE_SAMPLES = 5;      //!< 50ms
+    static const uint32_t LONG_PRESS_SAMPLES = 150;  //!< 1.5s
+    static const uint32_t IDLE_SAMPLES = 100;        //!< 1s without a button before the sampling stops
+    static const uint32_t PROBE_SAMPLES = 4;         //!< Long enough for a new reading of the scanner
+    static const uint64_t POLL_PERIOD_us = 300000;
+    static void onTimer(void *arg);
+    static void onWakeTimer(void *arg);
+    static void IRAM_ATTR onButtonInterrupt(void *arg);
+    void sample();
+    void sleep();
+    void wakeUp();
+    void pushEvent(EventType type, ButtonSelection button);
     ButtonSelection getPushedButton();
+    AdcScanner &_adc;
+    EventBus &_bus;
     const int _adcPin;
-    ButtonSelection _lastButtonState;
+    MedianFilter<uint16_t, 3> _adcValue;
+    volatile ButtonSelection _lastButtonState;
     ButtonSelection _bouncingButtonState;
-    AsyncDelay _debounceDelay;
-};
\ No newline at end of file
+    uint32_t _bouncingSamples = 0;
+    uint32_t _pressedSamples = 0;
+    volatile bool _stable = false;
+    esp_timer_handle_t _timer = nullptr;
+    esp_timer_handle_t _wakeTimer = nullptr;    //!< Probes the buttons while sleeping, or wakes up right away
+    volatile bool _sleepAllowed = false;
+    volatile bool _wakeRequested = false;       //!< By the GPIO interrupt or setSleepAllowed(false), restarts the idle time
+    bool _sleeping = false;                     //!< Only used in the esp_timer task
+    uint32_t _idleSamples = 0;
+};
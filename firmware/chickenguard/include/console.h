@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Line based command console on the serial port, for diagnostics in the field.
+ * @details A low priority task polls the serial port, so reading never blocks the other tasks.  Characters are collected in a fixed
+ * line buffer, a complete line is split in a command name and its arguments and looked up in a static command table.  Nothing is
+ * allocated on the heap.
+ */
+class Console
+{
+public:
+    /**
+     * @brief Called with the rest of the line after the command name, without leading spaces.  Write the output to the stream.
+     */
+    typedef void (*Handler)(Print &output, const char *args);
+    struct Command
+    {
+        const char *name;
+        const char *help;
+        Handler handler;
+    };
+    static const uint32_t TASK_STACK_SIZE = 3072; //!< [bytes]
+    Console(Stream &stream, const Command *commands, size_t commandCount);
+    ~Console();
+    bool begin();
+
+private:
+    static const size_t MAX_LINE_LENGTH = 64;
+    static const uint32_t POLL_PERIOD = 100;     //!< [ms]
+    static void task(void *arg);
+    void poll();
+    void execute(char *line);
+    void printHelp();
+    Stream &_stream;
+    const Command *_commands;
+    const size_t _commandCount;
+    char _line[MAX_LINE_LENGTH + 1];
+    size_t _length = 0;
+    bool _overflow = false;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "buttons.h"
+#include "motorControl.h"
+#include "eventLog.h"
+
+/**
+ * @brief Typed events from the producers (RTC, buttons, motor, webserver, power) to the subscribers.
+ * @details The queue and the subscriber table are statically allocated.  Subscribers register their handlers at init, before
+ * the first event is dispatched.  All handlers run in the task that calls dispatch(), which blocks on the queue between events.
+ */
+class EventBus
+{
+public:
+    enum class EventType
+    {
+        AlarmFired,
+        ButtonEvent,
+        MotorStopped,
+        ConfigReceived,
+        TimeReceived,
+        BatteryLow,
+        PowerTimeout
+    };
+    enum class Alarm
+    {
+        OpenDoor,
+        CloseDoor
+    };
+    struct Event
+    {
+        EventType type;
+        union
+        {
+            Alarm alarm;                          //!< AlarmFired
+            ButtonReader::Event button;           //!< ButtonEvent
+            struct
+            {
+                MotorControl::StopReason stopReason;
+                EventLog::Source source;          //!< Origin of the command
+                bool opening;
+                uint16_t peakCurrent;
+                uint32_t travelTime_ms;
+            } motorRun;                           //!< MotorStopped
+            struct
+            {
+                long utc;
+                char timeZone[32];
+            } time;                               //!< TimeReceived
+            struct
+            {
+                float latitude;
+                float longitude;
+                uint8_t doorControl;              //!< NonVolatileStorage::DoorControl
+                uint8_t openHour;                 //!< Local time, out of range when the message had no valid time
+                uint8_t openMinute;
+                uint8_t closeHour;
+                uint8_t closeMinute;
+            } config;                             //!< ConfigReceived, a copy : the webserver's buffer is gone when it's handled
+            uint32_t batteryPercent;              //!< BatteryLow
+        };
+    };
+    typedef void (*Handler)(const Event &event);
+
+    EventBus();
+    ~EventBus();
+    bool begin();
+    bool subscribe(EventType type, Handler handler);
+    bool post(const Event &event);
+    bool dispatch(TickType_t timeout);
+
+private:
+    static const size_t QUEUE_LENGTH = 8;
+    static const TickType_t CONFIG_POST_TIMEOUT = pdMS_TO_TICKS(1000); //!< The configuration events can't be produced again
+    static const size_t MAX_SUBSCRIBERS = 12;
+    struct Subscription
+    {
+        EventType type;
+        Handler handler;
+    };
+    QueueHandle_t _queue = nullptr;
+    StaticQueue_t _queueBuffer;
+    uint8_t _queueStorage[QUEUE_LENGTH * sizeof(Event)];
+    Subscription _subscriptions[MAX_SUBSCRIBERS];
+    size_t _subscriptionCount = 0;
+};
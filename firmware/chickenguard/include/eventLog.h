@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+/**
+ * @brief Log of the motor runs, in a dedicated flash partition (see partitions.csv).
+ * @details The partition is used as a ring of sectors.  Each sector starts with a header holding a sequence number, followed by
+ * fixed size records.  Records are appended in the active sector, the sector with the highest sequence number.  When it's full, the
+ * next sector, which holds the oldest records, is erased and becomes the active sector.  So appending costs at most one sector
+ * erase, also when the partition is full, and all sectors wear evenly.
+ * Erased flash reads as 0xFF, so the first free record of the active sector is found with a binary search at boot.  A record that
+ * was being written when the power failed doesn't match its CRC and is skipped.
+ * The log is shared by the scheduler task (append) and the network task (read), so it's protected by a mutex.
+ */
+class EventLog
+{
+public:
+    enum class Source
+    {
+        Alarm,
+        Button,
+        Console
+    };
+    struct __attribute__((packed)) Record
+    {
+        uint32_t utc;
+        uint8_t flags;          //!< bits 0..1 : Source, bit 2 : 1 = opening, bits 3..5 : MotorControl::StopReason
+        uint8_t crc;            //!< CRC8 of the other fields
+        uint16_t peakCurrent;   //!< Highest filtered motor current [ADC value]
+        uint16_t battery_mV;
+        uint16_t travelTime_ds; //!< [0.1s] from the end of the dead time to the stop
+    };
+    static_assert(sizeof(Record) == 12, "Record size is part of the flash layout");
+
+    EventLog();
+    ~EventLog();
+    bool begin();
+    bool append(Source source, bool opening, uint8_t stopReason, uint16_t peakCurrent, uint16_t battery_mV, uint32_t travelTime_ms);
+    size_t read(size_t first, Record *records, size_t count);
+    size_t getCount() const { return _count; }
+    static Source getSource(const Record &record) { return static_cast<Source>(record.flags & 0x03); }
+    static bool isOpening(const Record &record) { return record.flags & 0x04; }
+    static uint8_t getStopReason(const Record &record) { return (record.flags >> 3) & 0x07; }
+
+private:
+    struct SectorHeader
+    {
+        uint32_t magic;
+        uint32_t sequence;
+    };
+    static const size_t SECTOR_SIZE = 4096;
+    static const size_t RECORDS_PER_SECTOR = (SECTOR_SIZE - sizeof(SectorHeader)) / sizeof(Record);
+    bool readHeader(size_t sector, SectorHeader &header);
+    bool startSector(size_t sector, uint32_t sequence);
+    size_t findFreeSlot(size_t sector);
+    bool isErased(const Record &record) const;
+    static uint8_t crc(const Record &record);
+    static size_t recordOffset(size_t sector, size_t slot)
+    {
+        return sector * SECTOR_SIZE + sizeof(SectorHeader) + slot * sizeof(Record);
+    }
+    const esp_partition_t *_partition = nullptr;
+    size_t _sectorCount = 0;
+    size_t _sector = 0;       //!< Active sector
+    uint32_t _sequence = 0;   //!< Sequence number of the active sector
+    size_t _slot = 0;         //!< Next free record in the active sector
+    size_t _count = 0;        //!< Number of records, including the ones with a CRC error
+    SemaphoreHandle_t _mutex = nullptr;
+    StaticSemaphore_t _mutexBuffer;
+};
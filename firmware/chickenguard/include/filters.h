@@ -0,0 +1,223 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Fixed capacity filters on integer samples.
+ * @details No heap, no floating point : the ESP32-C3 has no FPU.  Capacity is a template parameter, so the storage is part of the object.
+ */
+
+/**
+ * @brief Circular buffer of the last N samples
+ */
+template <typename T, size_t N>
+class SampleWindow
+{
+public:
+    void clear()
+    {
+        _count = 0;
+        _next = 0;
+    }
+    /**
+     * @brief Add a sample
+     * @param value new sample
+     * @param evicted the sample that has been overwritten, only valid when true is returned
+     * @return true when the window was full and a sample has been evicted
+     */
+    bool push(T value, T &evicted)
+    {
+        bool full = _count == N;
+        evicted = _samples[_next];
+        _samples[_next] = value;
+        _next = (_next + 1) % N;
+        if (!full)
+        {
+            _count++;
+        }
+        return full;
+    }
+    size_t count() const { return _count; }
+    bool isFull() const { return _count == N; }
+    const T &operator[](size_t i) const { return _samples[i]; }
+
+private:
+    T _samples[N] = {};
+    size_t _count = 0;
+    size_t _next = 0;
+};
+
+/**
+ * @brief Average of the last N samples.  Keeps a running sum, so adding a sample and getting the average are O(1).
+ * @tparam Sum accumulator type, must hold N times the largest sample
+ */
+template <typename T, size_t N, typename Sum = int32_t>
+class MovingAverage
+{
+public:
+    void clear()
+    {
+        _window.clear();
+        _sum = 0;
+    }
+    void add(T value)
+    {
+        T evicted;
+        if (_window.push(value, evicted))
+        {
+            _sum -= evicted;
+        }
+        _sum += value;
+    }
+    /**
+     * @brief Get the average, rounded to the nearest integer.  Returns 0 when there are no samples.
+     */
+    T get() const
+    {
+        Sum count = static_cast<Sum>(_window.count());
+        if (count == 0)
+        {
+            return 0;
+        }
+        return static_cast<T>((_sum + (_sum >= 0 ? count / 2 : -count / 2)) / count);
+    }
+    size_t count() const { return _window.count(); }
+    bool isFull() const { return _window.isFull(); }
+
+private:
+    SampleWindow<T, N> _window;
+    Sum _sum = 0;
+};
+
+/**
+ * @brief Median of the last N samples.  Intended for small N : get() sorts a copy of the window, O(N^2).
+ */
+template <typename T, size_t N>
+class MedianFilter
+{
+public:
+    void clear() { _window.clear(); }
+    void add(T value)
+    {
+        T evicted;
+        _window.push(value, evicted);
+    }
+    /**
+     * @brief Get the median.  For an even number of samples, the lower of both middle samples is returned.  Returns 0 when empty.
+     */
+    T get() const
+    {
+        size_t count = _window.count();
+        if (count == 0)
+        {
+            return 0;
+        }
+        T sorted[N];
+        for (size_t i = 0; i < count; i++)
+        {
+            // Insertion sort
+            T value = _window[i];
+            size_t j = i;
+            for (; j > 0 && sorted[j - 1] > value; j--)
+            {
+                sorted[j] = sorted[j - 1];
+            }
+            sorted[j] = value;
+        }
+        return sorted[(count - 1) / 2];
+    }
+    size_t count() const { return _window.count(); }
+
+private:
+    SampleWindow<T, N> _window;
+};
+
+/**
+ * @brief Exponentially weighted moving average with a weight of 1/2^SHIFT for the new sample.
+ * @details The state is kept with SHIFT extra fractional bits, so small changes are not lost to rounding.  The first sample initializes the filter.
+ * @tparam Acc accumulator type, must hold the largest sample shifted left by SHIFT bits
+ */
+template <typename T, uint8_t SHIFT, typename Acc = int32_t>
+class Ewma
+{
+    static_assert(SHIFT > 0, "SHIFT must be at least 1");
+
+public:
+    void clear() { _initialized = false; }
+    void add(T value)
+    {
+        Acc scaled = static_cast<Acc>(value) << SHIFT;
+        if (!_initialized)
+        {
+            _state = scaled;
+            _initialized = true;
+            return;
+        }
+        // Rounded, so the state converges to the input instead of stopping just below it
+        _state += (scaled - _state + (static_cast<Acc>(1) << (SHIFT - 1))) >> SHIFT;
+    }
+    T get() const { return static_cast<T>((_state + (static_cast<Acc>(1) << (SHIFT - 1))) >> SHIFT); }
+    bool isInitialized() const { return _initialized; }
+
+private:
+    Acc _state = 0;
+    bool _initialized = false;
+};
+
+/**
+ * @brief Minimum and maximum of the last N samples.
+ * @details Adding is O(1).  Only when the current extreme is evicted from the window, the window is scanned, which is O(N).
+ */
+template <typename T, size_t N>
+class MinMaxFilter
+{
+public:
+    void clear() { _window.clear(); }
+    void add(T value)
+    {
+        T evicted;
+        bool wasEvicted = _window.push(value, evicted);
+        if (_window.count() == 1)
+        {
+            _min = _max = value;
+            return;
+        }
+        if (wasEvicted && (evicted == _min || evicted == _max))
+        {
+            rescan();
+            return;
+        }
+        if (value < _min)
+        {
+            _min = value;
+        }
+        if (value > _max)
+        {
+            _max = value;
+        }
+    }
+    T getMin() const { return _min; }
+    T getMax() const { return _max; }
+    size_t count() const { return _window.count(); }
+
+private:
+    void rescan()
+    {
+        _min = _max = _window[0];
+        for (size_t i = 1; i < _window.count(); i++)
+        {
+            if (_window[i] < _min)
+            {
+                _min = _window[i];
+            }
+            if (_window[i] > _max)
+            {
+                _max = _window[i];
+            }
+        }
+    }
+    SampleWindow<T, N> _window;
+    T _min = 0;
+    T _max = 0;
+};
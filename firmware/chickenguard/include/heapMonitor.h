@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/**
+ * @brief Keeps a short history of the heap usage and of the stack high water marks of the tasks.
+ * @details The webserver, ArduinoJson and String allocate on the heap.  A long web session can fragment the heap until an allocation
+ * fails, so the free heap and the largest free block are sampled periodically.  isLow() tells when the webserver should be stopped,
+ * before an allocation fails.
+ * sample() is called by a single task.  A dump that runs concurrently may show a sample that is being updated.
+ */
+class HeapMonitor
+{
+public:
+    struct Sample
+    {
+        uint32_t time_s;       //!< Uptime
+        uint32_t freeHeap;
+        uint32_t largestBlock; //!< Largest block that can be allocated
+        uint32_t minFreeHeap;  //!< Minimum free heap since boot
+        uint16_t stackHighWaterMark[4];
+    };
+    static const size_t MAX_TASKS = sizeof(Sample::stackHighWaterMark) / sizeof(Sample::stackHighWaterMark[0]);
+    static const uint32_t LOW_FREE_HEAP = 16384;     //!< [bytes]
+    static const uint32_t LOW_LARGEST_BLOCK = 8192;  //!< [bytes] a websocket message and the JSON buffers must still fit
+
+    HeapMonitor();
+    ~HeapMonitor();
+    bool addTask(TaskHandle_t task);
+    const Sample &sample();
+    bool isLow() const;
+    void dump(Print &output) const;
+
+private:
+    static const size_t HISTORY_LENGTH = 16;
+    TaskHandle_t _tasks[MAX_TASKS];
+    size_t _taskCount = 0;
+    Sample _history[HISTORY_LENGTH];
+    size_t _sampleCount = 0;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Measures the intervals between the activations of a periodic task.
+ * @details Call record() at the start of each activation.  log() prints the minimum, mean and maximum interval since the previous
+ * log() and restarts the measurement.  Call restart() when the task resumes after a pause, so the pause isn't counted as jitter.
+ */
+class JitterMeter
+{
+public:
+    JitterMeter(const char *name, uint32_t period_us);
+    void record(int64_t now_us);
+    void restart() { _lastActivation = 0; }
+    void log();
+
+private:
+    const char *_name;
+    const uint32_t _period_us;
+    int64_t _lastActivation = 0;
+    uint32_t _count = 0;
+    uint32_t _minInterval = UINT32_MAX;
+    uint32_t _maxInterval = 0;
+    uint64_t _sumInterval = 0;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Preferences.h"
+
+/**
+ * @brief Learns the current profile and travel time of the door from successful motor runs.
+ * @details All currents are ADC-counts, zero offset removed, normalized to a motor voltage of 4.5V.  That way runs done at
+ * different battery voltages can be combined.  The statistics are kept in NVS, so that they survive the power off after each run.
+ */
+class MotorCalibration
+{
+public:
+    enum class Direction
+    {
+        Raise,
+        Lower
+    };
+    enum class RunResult
+    {
+        EndPosition,    //!< The door reached its end position
+        Timeout,        //!< The door was still moving normally when the timeout expired
+        Failed          //!< Any other stop, not learned from
+    };
+    struct Thresholds
+    {
+        uint16_t raisingUnderload;
+        uint16_t raisingOverload;
+        uint16_t loweringOverload;
+        uint16_t noMotor;
+        unsigned long raiseDoorTime;
+        unsigned long lowerDoorTime;
+    };
+
+    MotorCalibration();
+    ~MotorCalibration();
+    void restore();
+    void setZeroOffset(float adcOffset);
+    float getZeroOffset() const;
+    void startRun(Direction direction, float motorVoltage_mV);
+    void addSample(uint16_t current);
+    void endRun(RunResult result, unsigned long travelTime_ms);
+    bool getThresholds(float motorVoltage_mV, Thresholds &thresholds) const;
+    static float voltageScale(float motorVoltage_mV);
+
+private:
+    struct DirectionStatistics
+    {
+        uint16_t runCount;     //!< Number of successful runs learned from, saturates
+        float meanCurrent;     //!< Mean running current at 4.5V
+        float stdDevCurrent;   //!< Standard deviation of the running current at 4.5V
+        uint32_t travelTime;   //!< Time from motor start until end position, in ms
+    };
+    struct Statistics
+    {
+        uint8_t version;
+        float zeroOffset;
+        DirectionStatistics raise;
+        DirectionStatistics lower;
+    };
+    void save();
+
+    Preferences _preferences;
+    Statistics _statistics;
+    Direction _direction = Direction::Raise;
+    float _runVoltageScale = 1.0f;
+    // Integer sums of the samples of the ongoing run, so that no floating point math is needed per sample
+    uint32_t _sampleCount = 0;
+    uint32_t _sampleSum = 0;
+    uint64_t _sampleSquareSum = 0;
+};
@@ -2,19 +2,37 @@
 
 #include <Arduino.h>
 #include "AsyncDelay.h"
-#include "RunningAverage.h"
+#include "filters.h"
+#include "adcScanner.h"
+#include "motorCalibration.h"
+#include "motorTrace.h"
 
 class MotorControl {
     public:
-        MotorControl(uint8_t pinIn1, uint8_t pinIn2, uint8_t pinCurrentSense);
+        MotorControl(uint8_t pinIn1, uint8_t pinIn2, AdcScanner &adc, uint8_t pinCurrentSense);
         ~MotorControl();
+        static const uint16_t ADC_PERIOD = 50;   //!< [ms] period of the current sense samples
 
         void init(float motorVoltage);
+        void setMotorVoltage(float motorVoltage_mV);
         bool run();
         void off();
         void demo();
         void openDoor();
         void closeDoor();
+        enum class StopReason {
+            None,
+            EndPosition,
+            Overload,
+            Timeout,
+            NoCurrent
+        };
+        StopReason getStopReason() const { return _stopReason; }
+        uint16_t getRawCurrent() const { return _lastSample; }
+        uint16_t getCurrent() const { return _currentSense.get(); }
+        uint16_t getPeakCurrent() const { return _peakCurrent; }          //!< Highest filtered current of the last run
+        unsigned long getTravelTime() const { return _travelTime; }       //!< [ms] last run, from the end of the dead time
+        uint8_t getStateCode() const { return static_cast<uint8_t>(_state); }
     private:
         enum class MotorState {
             Off,
@@ -29,18 +47,33 @@ class MotorControl {
             Lower,
             None
         };
-        bool readAdc(float& current);
-        float limitConversion(float currentLimit4V5, float motorVoltage_mV);
+        bool readAdc(uint16_t& current);
+        bool measureZeroOffset(float &offset);
+        void stop(StopReason reason);
+        void setState(MotorState state);
+        uint16_t limitConversion(float currentLimit4V5, float motorVoltage_mV);
         uint8_t _pinIn1;
         uint8_t _pinIn2;
+        AdcScanner &_adc;
         uint8_t _pinCurrentSense;
         AsyncDelay _motorOnTime;
-        AsyncDelay _AdcSamplingPeriod;
-        RunningAverage _currentSense;
+        uint32_t _lastReadingCount = 0;
+        MovingAverage<uint16_t, 20> _currentSense;
+        uint16_t _lastSample = 0;
+        uint16_t _peakCurrent = 0;
+        unsigned long _travelTime = 0;
         MotorState _state  = MotorState::Off;
         MotorDirection _direction = MotorDirection::None;
-        float RAISING_UNDERLOAD_CURRENT;
-        float RAISING_OVERLOAD_CURRENT;
-        float LOWERING_OVERLOAD_CURRENT;
-        float NO_MOTOR_CURRENT;
+        StopReason _stopReason = StopReason::None;
+        MotorCalibration _calibration;
+        MotorTrace _trace;
+        float _motorVoltage = 0;
+        float _loadScale = 1.0f;        //!< Scales the current at the measured motor voltage to the one at init()
+        unsigned long _travelStartTime = 0;
+        unsigned long RAISE_DOOR_TIME = 25000;
+        unsigned long LOWER_DOOR_TIME = 25000;
+        uint16_t RAISING_UNDERLOAD_CURRENT;
+        uint16_t RAISING_OVERLOAD_CURRENT;
+        uint16_t LOWERING_OVERLOAD_CURRENT;
+        uint16_t NO_MOTOR_CURRENT;
 };
\ No newline at end of file
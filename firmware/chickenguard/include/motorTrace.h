@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Records the current samples and state transitions of a motor run.
+ * @details The trace is kept in RAM during the run and stored in NVS when the run ends.  The last TRACE_COUNT runs are kept.
+ * Encoding of a stored trace (little endian):
+ *  - Header : see struct Header
+ *  - Tokens : each token starts with a varint h and a varint with the ms elapsed since the previous token.
+ *      - h bit0 = 0 : ADC sample, h >> 1 is the zigzag encoded difference with the previous sample
+ *      - h bit0 = 1 : event, h >> 1 is the EventType, followed by a varint with the event value
+ * Use tools/decode_trace.py to convert the traces to CSV.
+ */
+class MotorTrace
+{
+public:
+    enum class EventType
+    {
+        State,  //!< value = new MotorControl::MotorState
+        Stop    //!< value = MotorControl::StopReason
+    };
+    MotorTrace();
+    ~MotorTrace();
+    void begin(uint8_t direction, uint16_t motorVoltage_mV);
+    void addSample(uint16_t adcValue);
+    void addEvent(EventType type, uint8_t value);
+    void end();
+    static size_t dump(Print &out);
+
+private:
+    struct Header
+    {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t direction;
+        uint32_t utc;             //!< Start of the run, seconds since epoch
+        uint16_t motorVoltage_mV; //!< Motor voltage measured at boot
+        uint16_t length;          //!< Number of token bytes following the header
+        uint8_t flags;
+        uint8_t reserved[3];
+    };
+    static const size_t TRACE_COUNT = 4;
+    static const size_t MAX_TRACE_SIZE = 1536;
+    static const uint8_t FLAG_TRUNCATED = 0x01;
+    bool putVarint(uint32_t value);
+    bool putToken(uint32_t header);
+    Header _header;
+    uint8_t _data[MAX_TRACE_SIZE];
+    size_t _length = 0;
+    bool _active = false;
+    unsigned long _lastTokenTime = 0;
+    uint16_t _lastSample = 0;
+};
@@ -1,6 +1,10 @@
 #pragma once
 #include <stdint.h>
 #include <AsyncDelay.h>
+#include <esp_timer.h>
+#include "adcScanner.h"
+
+class EventBus;
 
 class powerControl
 {
@@ -10,22 +14,30 @@ public:
         Alkaline,
         NiMH
     };
-    powerControl(const BatteryTech batteryTech, const uint32_t cellCount, const float voltageDividerScale);
+    powerControl(AdcScanner &adc, EventBus &bus, const BatteryTech batteryTech, const uint32_t cellCount, const float voltageDividerScale);
+    static const uint16_t ADC_PERIOD = 100;          //!< [ms] the battery voltage is averaged over this period
+    static const uint16_t MAX_mV_MEASUREMENT = 2500; //!< [mV] at the ADC pin, end of the 11dB range : higher conversions are rejected
     bool init();
-    void run();
     uint32_t getVoltage_mV();
+    uint32_t getInstantVoltage_mV();
     uint32_t getVoltage_percent();
     bool isBatteryLow() const;
     void powerOff();
 private:
+    static void onTimer(void *arg);
+    void update();
+    AdcScanner &_adc;
+    EventBus &_bus;
     const BatteryTech _batteryTech;
     const uint32_t _cellCount;
     const float _voltageDividerScale;
-    const unsigned long POWERED_ON_PERIOD = 180000;  //!< Device will power off after this amount of milliseconds.
+    const unsigned long POWERED_ON_PERIOD = 180000;  //!< PowerTimeout is posted after this amount of milliseconds.
     const unsigned long LED_BLINK_PERIOD = 200;     //!< LED will blink at this period.
+    const unsigned long BATTERY_CHECK_PERIOD = 1000; //!< Battery and powered on period are checked at this period.
     const uint32_t LOW_BATTERY_PERCENT = 20;        //!< Battery is considered low when it reaches this percentage.
     AsyncDelay _powerOnPeriod;
-    AsyncDelay _ledBlinkDelay;
-    bool _batteryLow = false;
+    esp_timer_handle_t _timer = nullptr;
+    bool _powerTimeoutPosted = false;
+    volatile bool _batteryLow = false;
 };
 
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+/**
+ * @brief Selects the CPU frequency range and light sleep from what the firmware is doing.
+ * @details The mode with the highest demand wins : WiFi active > motor running > idle.  When the framework has been built with
+ * power management (CONFIG_PM_ENABLE), the frequency floats between the minimum and maximum of the mode and, with tickless idle
+ * (CONFIG_FREERTOS_USE_TICKLESS_IDLE), the chip light-sleeps until the next task deadline, timer or interrupt.  Without it, the
+ * CPU frequency is fixed at the maximum of the mode.
+ * Drivers keep their own power management locks : the continuous ADC scan keeps the APB clock at 80MHz while it runs.  The idle
+ * handler is told when the idle mode is entered and left, so that the ADC scan can be paused.
+ * The Arduino builds have neither option : they need the Arduino core built as an ESP-IDF component, which isn't set up yet.
+ */
+class PowerPolicy
+{
+public:
+    enum class Mode
+    {
+        Idle,
+        MotorRunning,
+        WifiActive
+    };
+    PowerPolicy();
+    ~PowerPolicy();
+    void setIdleHandler(void (*handler)(bool idle)) { _idleHandler = handler; }
+    bool begin();
+    void setMotorRunning(bool running);
+    void setWifiActive(bool active);
+    Mode getMode() const { return _mode; }
+
+private:
+    struct Setting
+    {
+        uint16_t maxFrequency_MHz;
+        uint16_t minFrequency_MHz;
+        bool lightSleep;
+    };
+    void apply();
+    static const Setting SETTINGS[];
+    SemaphoreHandle_t _mutex = nullptr;
+    StaticSemaphore_t _mutexBuffer;
+    bool _motorRunning = false;
+    bool _wifiActive = false;
+    Mode _mode = Mode::Idle;
+    bool _applied = false;
+    void (*_idleHandler)(bool idle) = nullptr;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Execution time statistics per firmware section, measured with the CPU cycle counter.
+ * @details Only compiled in when ENABLE_PROFILER is defined.  Otherwise PROFILE_SECTION() expands to nothing and the Profiler class
+ * isn't used.
+ * Each section is recorded by a single task, so recording doesn't lock.  A dump that runs concurrently with a recording may show
+ * that section slightly inconsistent.
+ * The cycle count doesn't depend on the CPU frequency, the conversion to time uses the frequency at the time of the dump.
+ * The dump shows the cost of the profiler per section, as a percentage of the section time including that cost.  It should stay
+ * under a few percent : short sections that run often are the ones to watch.
+ *
+ * Binary frame for the web clients (little endian), decoded by data/index.js :
+ *  - uint8_t type (FRAME_TYPE_PROFILE), uint8_t version, uint8_t section count, uint8_t CPU frequency [MHz]
+ *  - section count times : uint32_t count, uint32_t min, uint32_t avg, uint32_t max [cycles],
+ *    HISTOGRAM_BUCKETS times uint16_t : number of executions that took [2^i, 2^(i+1)) cycles, saturating
+ */
+class Profiler
+{
+public:
+    enum class Section
+    {
+        MotorRun,
+        RtcPoll,
+        ButtonSample,
+        BatteryCheck,
+        WebserverLoop,
+        EventHandlers,
+        Count
+    };
+    static const size_t HISTOGRAM_BUCKETS = 24;
+    static const size_t MAX_FRAME_SIZE = 4 + static_cast<size_t>(Section::Count) * (16 + 2 * HISTOGRAM_BUCKETS);
+
+    static void calibrate();
+    static void record(Section section, uint32_t cycles);
+    static void dump(Print &output);
+    static size_t getFrame(uint8_t *frame, size_t size);
+    static void reset();
+
+private:
+    struct Statistics
+    {
+        uint32_t count;
+        uint32_t minCycles;
+        uint32_t maxCycles;
+        uint64_t sumCycles;
+        uint16_t histogram[HISTOGRAM_BUCKETS];
+    };
+    static const uint8_t FRAME_TYPE_PROFILE = 2;
+    static const uint8_t FRAME_VERSION = 1;
+    static Statistics _statistics[static_cast<size_t>(Section::Count)];
+    static uint32_t _overhead; //!< [cycles] measured by a section besides its own code, subtracted
+    static uint32_t _cost;     //!< [cycles] added to the profiled code by each execution of a section, including record()
+};
+
+#ifdef ENABLE_PROFILER
+#include <hal/cpu_hal.h>
+
+/**
+ * @brief Records the execution time of the enclosing scope
+ */
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler::Section section) : _section(section), _start(cpu_hal_get_cycle_count()) {}
+    ~ProfileScope() { Profiler::record(_section, cpu_hal_get_cycle_count() - _start); }
+
+private:
+    const Profiler::Section _section;
+    const uint32_t _start;
+};
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SECTION(section) ProfileScope PROFILE_CONCAT(_profileScope, __LINE__)(Profiler::Section::section)
+#else
+#define PROFILE_SECTION(section)
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Batches motor samples into binary frames for the web clients.
+ * @details Frame layout (little endian), decoded by data/index.js :
+ *  - uint8_t type (FRAME_TYPE_MOTOR), uint8_t version, uint8_t sample count, uint8_t reserved
+ *  - sample count times : uint16_t ms since motor start, uint16_t raw current, uint16_t filtered current, uint16_t motor voltage [mV],
+ *    uint8_t motor state, uint8_t reserved
+ */
+class Telemetry
+{
+public:
+    struct Sample
+    {
+        uint16_t time_ms;
+        uint16_t rawCurrent;
+        uint16_t current;
+        uint16_t voltage_mV;
+        uint8_t state;
+        uint8_t reserved;
+    };
+    static const unsigned long SAMPLE_PERIOD = 50;   //!< 20Hz
+    static const size_t SAMPLES_PER_FRAME = 5;       //!< 4 frames per second
+    static const size_t MAX_FRAME_SIZE = 4 + SAMPLES_PER_FRAME * sizeof(Sample);
+
+    Telemetry();
+    ~Telemetry();
+    void start();
+    bool addSample(uint16_t rawCurrent, uint16_t current, uint16_t voltage_mV, uint8_t state);
+    bool isEmpty() const { return _frame.header.sampleCount == 0; }
+    const uint8_t *getFrame() const { return reinterpret_cast<const uint8_t *>(&_frame); }
+    size_t getFrameSize() const;
+    void clearFrame();
+
+private:
+    static const uint8_t FRAME_TYPE_MOTOR = 1;
+    static const uint8_t FRAME_VERSION = 1;
+    struct Header
+    {
+        uint8_t type;
+        uint8_t version;
+        uint8_t sampleCount;
+        uint8_t reserved;
+    };
+    struct Frame
+    {
+        Header header;
+        Sample samples[SAMPLES_PER_FRAME];
+    };
+    static_assert(sizeof(Sample) == 10, "Sample layout must match data/index.js");
+    static_assert(sizeof(Frame) == MAX_FRAME_SIZE, "Unexpected padding in Frame");
+    Frame _frame;
+    unsigned long _startTime = 0;
+};
@@ -11,9 +11,11 @@ public:
                 bool (*writeBytes)(uint8_t i2c_address, uint8_t reg, uint8_t size, const uint8_t *data));
     ~TimeControl();
 
-    bool init(String timeZone);
+    bool init(const char *(*getTimeZone)());
     bool hasValidTime();
-    bool updateMcuTime(long utc, const String timeZone);
+    bool useLocalTime();
+    bool getRtcTime(tm *timeinfo);
+    bool updateMcuTime(long utc, const char *timeZone);
     bool setOpenAlarmSunrise(double latitude, double longitude);
     bool setOpenAlarmFixTime(uint8_t hour, uint8_t minute);
     bool setCloseAlarmSunset(double latitude, double longitude);
@@ -21,12 +23,15 @@ public:
     bool disableAlarms();
     bool openDoorAlarmTriggered();
     bool closeDoorAlarmTriggered();
+    time_t getLocalTimeToday(uint8_t hour, uint8_t minute);
+    bool getSunTimesToday(double latitude, double longitude, time_t &sunrise, time_t &sunset);
 private:
-    bool setTimeZone(String timeZone);
+    bool setTimeZone(const char *timeZone);
     void doubleToHrMin(double time, uint8_t *hr, uint8_t *min);
     struct tm* localToUtcTimeObject(uint8_t hourLocal, uint8_t minuteLocal);
     struct tm *utcToUtcTimeObject(uint8_t hourUtc, uint8_t minuteUtc);
     void printLocalTime();
     DS1337 _rtc;
     bool _timeZoneSet = false;
+    const char *(*_getTimeZone)() = nullptr;
 };
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+#define TRACE_LEVEL_NONE 0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_WARN 2
+#define TRACE_LEVEL_INFO 3
+#define TRACE_LEVEL_DEBUG 4
+
+// Per module level, override with a build flag, e.g. -DTRACE_LEVEL_MOTOR=TRACE_LEVEL_DEBUG
+#ifndef TRACE_LEVEL_MOTOR
+#define TRACE_LEVEL_MOTOR TRACE_LEVEL_INFO
+#endif
+#ifndef TRACE_LEVEL_WEB
+#define TRACE_LEVEL_WEB TRACE_LEVEL_INFO
+#endif
+
+/**
+ * @brief Record an event in the trace log when the level is enabled for the module.
+ * @details The level check is a compile time constant, so disabled records don't generate any code.
+ * Usage : TRACE(MOTOR, DEBUG, MotorCurrent, current, 0);
+ */
+#define TRACE(module, level, event, arg0, arg1)                                            \
+    do                                                                                     \
+    {                                                                                      \
+        if (TRACE_LEVEL_##module >= TRACE_LEVEL_##level)                                   \
+        {                                                                                  \
+            TraceLog::record(TraceLog::Event::event, (uint16_t)(arg0), (uint32_t)(arg1)); \
+        }                                                                                  \
+    } while (0)
+
+/**
+ * @brief Binary log of events in a RAM ring buffer.
+ * @details Recording stores a timestamp, an event id and two integer arguments, without formatting and without blocking, so it
+ * can be used in the hot paths of any task.  The text is only formatted by dump(), using the format string of the event.
+ * When the ring is full, the oldest records are overwritten.
+ */
+class TraceLog
+{
+public:
+    enum class Event : uint16_t
+    {
+        MotorVoltage,     //!< arg0 = motor voltage [mV]
+        CurrentLimit,     //!< arg0 = limit at 4.5V [mA], arg1 = limit at the motor voltage
+        MotorCurrent,     //!< arg0 = filtered current, sent every ADC period while running
+        Underload,        //!< arg0 = current, arg1 = limit
+        UnderloadEnded,   //!< arg0 = current
+        NoCurrent,        //!< arg0 = current, arg1 = limit
+        Overload,         //!< arg0 = current, arg1 = limit
+        RaisingUnderload, //!< arg0 = current, arg1 = limit
+        LoweringOverload, //!< arg0 = current, arg1 = limit
+        Notify,           //!< arg0 = JSON length, arg1 = number of clients
+        Count
+    };
+    static void record(Event event, uint16_t arg0, uint32_t arg1);
+    static size_t dump(Print &output);
+
+private:
+    struct Record
+    {
+        uint32_t time_us;
+        uint16_t event;
+        uint16_t arg0;
+        uint32_t arg1;
+    };
+    /**
+     * @brief Record and the index it has been written for.  The sequence is index + 1 once the record is complete, so a reader
+     * can detect records that are being overwritten.
+     */
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence;
+        Record record;
+    };
+    static const size_t RING_SIZE = 256; //!< Must be a power of two
+    static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "RING_SIZE must be a power of two");
+    static Slot _ring[RING_SIZE];
+    static std::atomic<uint32_t> _writeIndex;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * @brief Binary websocket messages between the webserver and data/index.js.
+ * @details Fixed layouts, little endian, without padding.  Each message starts with a uint8_t type and a uint8_t version.  The
+ * telemetry and profiler frames are defined in telemetry.h and profiler.h.
+ * A client that sends Hello with a version it shares with the firmware gets the status as binary messages.  Other clients get
+ * JSON, as before.  The configuration is accepted in both formats.  Decoding a binary message is a check of the header and the length,
+ * without parsing and without a JSON document on the stack.
+ */
+namespace WsProtocol
+{
+    static const uint8_t VERSION = 1;
+
+    enum class MessageType : uint8_t
+    {
+        Telemetry = 1, //!< Telemetry::FRAME_TYPE_MOTOR
+        Profile = 2,   //!< Profiler::FRAME_TYPE_PROFILE
+        Config = 3,    //!< client to webserver
+        Status = 4,    //!< webserver to client
+        Hello = 5      //!< client to webserver, asks for binary status messages
+    };
+
+    struct __attribute__((packed)) Header
+    {
+        uint8_t type;
+        uint8_t version;
+    };
+
+    struct __attribute__((packed)) Config
+    {
+        Header header;
+        uint8_t doorControl;   //!< NonVolatileStorage::DoorControl
+        uint8_t openHour;      //!< Local time
+        uint8_t openMinute;
+        uint8_t closeHour;
+        uint8_t closeMinute;
+        int32_t utc;           //!< Time of the client
+        float latitude;
+        float longitude;
+        char timeZone[32];     //!< Zero padded
+    };
+    static_assert(sizeof(Config) == 51, "Config layout must match data/index.js");
+
+    struct __attribute__((packed)) Status
+    {
+        Header header;
+        uint8_t batteryPercent;
+        uint8_t reserved;
+        uint32_t freeHeap;
+        uint32_t largestBlock;
+    };
+    static_assert(sizeof(Status) == 12, "Status layout must match data/index.js");
+
+    /**
+     * @brief Check the header and the length of a message received from a client
+     */
+    inline bool isMessage(const uint8_t *data, size_t len, MessageType type, size_t size)
+    {
+        return len == size && data[0] == static_cast<uint8_t>(type) && data[1] == VERSION;
+    }
+}
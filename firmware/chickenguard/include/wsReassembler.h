@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Reassembles the websocket messages of one client from the data events of AsyncWebSocket.
+ * @details AsyncWebSocket calls the data handler for each piece of a frame as it arrives from TCP, and a message may be split in
+ * several frames (RFC 6455 fragmentation).  Each piece is fed in order with the fields of its AwsFrameInfo.
+ * A message that arrives as a single piece, the usual case, is returned in place, without a copy.  Otherwise the pieces are
+ * collected in a fixed buffer.  A message that doesn't fit is discarded up to its last frame, and reported once as TooLarge.
+ * Pieces that don't follow each other are reported as Malformed and the message in progress is dropped.
+ * No heap : the buffer is part of the object.
+ */
+class WsReassembler
+{
+public:
+    static const size_t MAX_MESSAGE_SIZE = 320; //!< Largest JSON configuration, with a long time zone name
+    static const uint8_t OPCODE_CONTINUATION = 0;
+    static const uint8_t OPCODE_TEXT = 1;
+    static const uint8_t OPCODE_BINARY = 2;
+    enum class Result
+    {
+        Incomplete, //!< Waiting for more data
+        Complete,   //!< A message is available, until the next call of feed()
+        TooLarge,   //!< The message exceeds MAX_MESSAGE_SIZE, its remaining data is ignored
+        Malformed   //!< The data doesn't continue the message in progress, it's dropped
+    };
+
+    Result feed(uint8_t opcode, bool final, uint64_t frameLength, uint64_t index, uint8_t *data, size_t len);
+    void reset();
+    uint8_t getOpcode() const { return _opcode; }
+    uint8_t *getMessage() const { return _message; }
+    size_t getLength() const { return _messageLength; }
+
+private:
+    enum class State
+    {
+        Idle,
+        Receiving,
+        Discarding
+    };
+    Result fail(Result result);
+    State _state = State::Idle;
+    uint8_t _opcode = 0;            //!< Opcode of the message, text or binary
+    bool _finalFrame = false;       //!< The current frame is the last one of the message
+    uint64_t _frameLength = 0;
+    uint64_t _frameOffset = 0;      //!< Bytes received of the current frame
+    bool _frameOpen = false;        //!< The current frame isn't complete yet
+    size_t _length = 0;             //!< Bytes in _buffer
+    uint8_t *_message = nullptr;
+    size_t _messageLength = 0;
+    uint8_t _buffer[MAX_MESSAGE_SIZE];
+};
@@ -1,11 +1,18 @@
 #include "NonVolatileStorage.h"
 #include "esp_log.h"
+#include <esp_rom_crc.h>
+#include <time.h>
 
 static const char *TAG = "NonVolatileStorage";
 
-const bool RO_MODE = true;
 const bool RW_MODE = false;
 const char *NVS_NAMESPACE = "door";
+const char *NVS_KEY_CONFIG = "config";
+const char *NVS_KEY_DOOR_STATE = "doorState";
+// Same key and format as the firmware before the config blob, so it's kept by the migration
+const char *NVS_KEY_TIME_ZONE = "timeZone";
+static const uint8_t CONFIG_VERSION = 1;
+// Keys of the firmware before the config blob, only used for the migration
 const char *NVS_KEY_INIT = "nvsInit";
 const char *NVS_KEY_LATITUDE = "latitude";
 const char *NVS_KEY_LONGITUDE = "longitude";
@@ -14,7 +21,6 @@ const char *NVS_KEY_FIX_OPENING_TIME_MINUTE = "open_minute";
 const char *NVS_KEY_FIX_CLOSING_TIME_HOUR = "close_hour";
 const char *NVS_KEY_FIX_CLOSING_TIME_MINUTE = "close_minute";
 const char *NVS_KEY_DOOR_CONTROL = "doorControl";
-const char *NVS_KEY_TIME_ZONE = "timeZone";
 
 NonVolatileStorage::NonVolatileStorage()
 {
@@ -24,26 +30,123 @@ NonVolatileStorage::~NonVolatileStorage()
 {
 }
 
-void NonVolatileStorage::restoreAll()
+/**
+ * @brief Create the mutex, before the tasks that use the settings are started.  Nothing is read from NVS yet.
+ *
+ * @return true when the mutex could be created
+ */
+bool NonVolatileStorage::begin()
+{
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+    return _mutex != nullptr;
+}
+
+/**
+ * @brief Open the NVS handle at the first access.  It's never closed : Preferences commits every write.
+ *
+ * @return true when the handle is open
+ */
+bool NonVolatileStorage::open()
 {
-    _preferences.begin(NVS_NAMESPACE, RO_MODE);
-    if (!_preferences.isKey(NVS_KEY_INIT))
+    if (!_opened)
     {
-        _preferences.end();
-        ESP_LOGI(TAG, "Initializing NVS for the first time");
-        saveAll();
+        _opened = _preferences.begin(NVS_NAMESPACE, RW_MODE);
+        if (!_opened)
+        {
+            ESP_LOGE(TAG, "Can't open NVS namespace %s", NVS_NAMESPACE);
+        }
+    }
+    return _opened;
+}
+
+/**
+ * @brief Restore the settings from the config blob at the first access.  Migrates the settings of older firmware, or stores the
+ * defaults when there are no settings yet.  Called with the mutex taken.
+ */
+void NonVolatileStorage::restoreSettings()
+{
+    if (_settingsRestored)
+    {
+        return;
+    }
+    unsigned long startTime = micros();
+    if (restoreBlob())
+    {
+        _readTimes.settings_us = micros() - startTime;
+        ESP_LOGI(TAG, "Settings restored in %lu us", (unsigned long)_readTimes.settings_us);
+    }
+    else if (!open())
+    {
+        return;
+    }
+    else if (_preferences.isKey(NVS_KEY_INIT))
+    {
+        ESP_LOGI(TAG, "Migrating the settings to the config blob");
+        migrateKeys();
     }
     else
     {
-        _latitude = getFloat(NVS_KEY_LATITUDE, 0);
-        _longitude = getFloat(NVS_KEY_LONGITUDE, 0);
-        _fixOpeningTime_hour = getUChar(NVS_KEY_FIX_OPENING_TIME_HOUR, 0);
-        _fixOpeningTime_minute = getUChar(NVS_KEY_FIX_OPENING_TIME_MINUTE, 0);
-        _fixClosingTime_hour = getUChar(NVS_KEY_FIX_CLOSING_TIME_HOUR, 0);
-        _fixClosingTime_minute = getUChar(NVS_KEY_FIX_CLOSING_TIME_MINUTE, 0);
-        _doorControl = static_cast<DoorControl>(getUChar(NVS_KEY_DOOR_CONTROL, 0));
-        _timeZone = getString(NVS_KEY_TIME_ZONE, "");
-        _preferences.end();
+        ESP_LOGI(TAG, "Initializing NVS for the first time");
+        save();
+    }
+    // Only set when the settings are valid, the other tasks wait on the mutex until then
+    _settingsRestored = true;
+}
+
+/**
+ * @brief Read the config blob in a single read
+ *
+ * @return true when a valid blob has been restored
+ */
+bool NonVolatileStorage::restoreBlob()
+{
+    Blob blob;
+    if (!open())
+    {
+        return false;
+    }
+    size_t length = _preferences.getBytes(NVS_KEY_CONFIG, &blob, sizeof(blob));
+    if (length == 0)
+    {
+        return false;
+    }
+    if (length != sizeof(blob) || blob.version != CONFIG_VERSION || blob.crc != crc(blob))
+    {
+        ESP_LOGE(TAG, "Invalid config blob: %u bytes, version %u", (unsigned)length, blob.version);
+        return false;
+    }
+    fromBlob(blob);
+    _stored = blob;
+    _storedValid = true;
+    return true;
+}
+
+/**
+ * @brief Read the settings stored as separate keys by older firmware, store them as a blob and then remove these keys.  The time
+ * zone key is kept as it is.
+ */
+void NonVolatileStorage::migrateKeys()
+{
+    _latitude = getFloat(NVS_KEY_LATITUDE, 0);
+    _longitude = getFloat(NVS_KEY_LONGITUDE, 0);
+    _fixOpeningTime_hour = getUChar(NVS_KEY_FIX_OPENING_TIME_HOUR, 0);
+    _fixOpeningTime_minute = getUChar(NVS_KEY_FIX_OPENING_TIME_MINUTE, 0);
+    _fixClosingTime_hour = getUChar(NVS_KEY_FIX_CLOSING_TIME_HOUR, 0);
+    _fixClosingTime_minute = getUChar(NVS_KEY_FIX_CLOSING_TIME_MINUTE, 0);
+    _doorControl = static_cast<DoorControl>(getUChar(NVS_KEY_DOOR_CONTROL, 0));
+
+    save();
+    if (!_storedValid)
+    {
+        // Keep the keys, the migration will be retried at the next boot
+        return;
+    }
+    const char *keys[] = {NVS_KEY_INIT, NVS_KEY_LATITUDE, NVS_KEY_LONGITUDE, NVS_KEY_FIX_OPENING_TIME_HOUR,
+                          NVS_KEY_FIX_OPENING_TIME_MINUTE, NVS_KEY_FIX_CLOSING_TIME_HOUR, NVS_KEY_FIX_CLOSING_TIME_MINUTE,
+                          NVS_KEY_DOOR_CONTROL};
+    for (const char *key : keys)
+    {
+        _preferences.remove(key);
     }
 }
 
@@ -65,30 +168,150 @@ uint8_t NonVolatileStorage::getUChar(const char *key, const uint8_t defaultValue
     return _preferences.getUChar(key, defaultValue);
 }
 
-String NonVolatileStorage::getString(const char *key, const String defaultValue)
+void NonVolatileStorage::getString(const char *key, char *value, size_t size, const char *defaultValue)
 {
-    if (!_preferences.isKey(key))
+    if (!_preferences.isKey(key) || _preferences.getString(key, value, size) == 0)
     {
-        return defaultValue;
+        strlcpy(value, defaultValue, size);
     }
-    return _preferences.getString(key, defaultValue);
 }
 
+/**
+ * @brief Write the config blob and the time zone, unless they're the same as the stored ones
+ */
 void NonVolatileStorage::saveAll()
 {
-    ESP_LOGI(TAG, "Saving all settings to NVS");
-    _preferences.begin(NVS_NAMESPACE, RW_MODE);
-    _preferences.putFloat(NVS_KEY_LATITUDE, _latitude);
-    _preferences.putFloat(NVS_KEY_LONGITUDE, _longitude);
-    _preferences.putUChar(NVS_KEY_FIX_OPENING_TIME_HOUR, _fixOpeningTime_hour);
-    _preferences.putUChar(NVS_KEY_FIX_OPENING_TIME_MINUTE, _fixOpeningTime_minute);
-    _preferences.putUChar(NVS_KEY_FIX_CLOSING_TIME_HOUR, _fixClosingTime_hour);
-    _preferences.putUChar(NVS_KEY_FIX_CLOSING_TIME_MINUTE, _fixClosingTime_minute);
-    _preferences.putUChar(NVS_KEY_DOOR_CONTROL, static_cast<uint8_t>(_doorControl));
-    _preferences.putString(NVS_KEY_TIME_ZONE, _timeZone);
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreSettings();
+    save();
+    xSemaphoreGive(_mutex);
+}
+
+/**
+ * @brief Write the settings that have changed.  Called with the mutex taken.
+ */
+void NonVolatileStorage::save()
+{
+    if (!open())
+    {
+        return;
+    }
+    Blob blob;
+    toBlob(blob);
+    if (_storedValid && memcmp(&blob, &_stored, sizeof(blob)) == 0)
+    {
+        ESP_LOGI(TAG, "Settings unchanged, not written");
+    }
+    else if (_preferences.putBytes(NVS_KEY_CONFIG, &blob, sizeof(blob)) != sizeof(blob))
+    {
+        ESP_LOGE(TAG, "Can't store the settings");
+    }
+    else
+    {
+        _stored = blob;
+        _storedValid = true;
+        _writeCount++;
+    }
+    if (_timeZoneChanged)
+    {
+        if (_preferences.putString(NVS_KEY_TIME_ZONE, _timeZone) == 0)
+        {
+            ESP_LOGE(TAG, "Can't store the time zone");
+        }
+        else
+        {
+            _timeZoneChanged = false;
+            _writeCount++;
+        }
+    }
+    ESP_LOGI(TAG, "%lu NVS writes since boot", (unsigned long)_writeCount);
+}
 
-    _preferences.putBool(NVS_KEY_INIT, true);
-    _preferences.end();
+void NonVolatileStorage::toBlob(Blob &blob) const
+{
+    memset(&blob, 0, sizeof(blob));
+    blob.version = CONFIG_VERSION;
+    blob.doorControl = static_cast<uint8_t>(_doorControl);
+    blob.fixOpeningTime_hour = _fixOpeningTime_hour;
+    blob.fixOpeningTime_minute = _fixOpeningTime_minute;
+    blob.fixClosingTime_hour = _fixClosingTime_hour;
+    blob.fixClosingTime_minute = _fixClosingTime_minute;
+    blob.latitude = _latitude;
+    blob.longitude = _longitude;
+    blob.crc = crc(blob);
+}
+
+void NonVolatileStorage::fromBlob(const Blob &blob)
+{
+    _doorControl = static_cast<DoorControl>(blob.doorControl);
+    _fixOpeningTime_hour = blob.fixOpeningTime_hour;
+    _fixOpeningTime_minute = blob.fixOpeningTime_minute;
+    _fixClosingTime_hour = blob.fixClosingTime_hour;
+    _fixClosingTime_minute = blob.fixClosingTime_minute;
+    _latitude = blob.latitude;
+    _longitude = blob.longitude;
+}
+
+uint32_t NonVolatileStorage::crc(const Blob &blob)
+{
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&blob), offsetof(Blob, crc));
+}
+
+/**
+ * @brief Restore the door state.  A run that was started but didn't end, because the power failed, leaves the position unknown.
+ */
+void NonVolatileStorage::restoreDoorState()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    unsigned long startTime = micros();
+    _doorState = {};
+    if (open() && _preferences.isKey(NVS_KEY_DOOR_STATE) &&
+        _preferences.getBytes(NVS_KEY_DOOR_STATE, &_doorState, sizeof(_doorState)) != sizeof(_doorState))
+    {
+        _doorState = {};
+    }
+    _readTimes.doorState_us = micros() - startTime;
+    if (_doorState.getConfidence() == DoorConfidence::Started)
+    {
+        ESP_LOGW(TAG, "Door run was interrupted");
+        _doorState.position = static_cast<uint8_t>(DoorPosition::Unknown);
+        _doorState.confidence = static_cast<uint8_t>(DoorConfidence::None);
+    }
+    ESP_LOGI(TAG, "Door position %u, confidence %u, restored in %lu us", _doorState.position, _doorState.confidence,
+             (unsigned long)_readTimes.doorState_us);
+    xSemaphoreGive(_mutex);
+}
+
+NonVolatileStorage::DoorState NonVolatileStorage::getDoorState()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    DoorState state = _doorState;
+    xSemaphoreGive(_mutex);
+    return state;
+}
+
+/**
+ * @brief Store the door state when it has changed, with the current time
+ */
+void NonVolatileStorage::setDoorState(DoorPosition position, DoorConfidence confidence)
+{
+    if (position == DoorPosition::Unknown)
+    {
+        confidence = DoorConfidence::None;
+    }
+    DoorState state = {static_cast<uint8_t>(position), static_cast<uint8_t>(confidence), static_cast<uint32_t>(time(nullptr))};
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    // When only the time changed, the time of the last change is kept
+    if (state.position != _doorState.position || state.confidence != _doorState.confidence)
+    {
+        if (!open() || _preferences.putBytes(NVS_KEY_DOOR_STATE, &state, sizeof(state)) != sizeof(state))
+        {
+            ESP_LOGE(TAG, "Can't store the door state");
+        }
+        // Also kept when it couldn't be stored, this boot still knows where the door is
+        _doorState = state;
+    }
+    xSemaphoreGive(_mutex);
 }
 
 void NonVolatileStorage::setGeoLocation(const float latitude, const float longitude)
@@ -103,99 +326,190 @@ void NonVolatileStorage::setGeoLocation(const float latitude, const float longit
         ESP_LOGE(TAG, "Longitude out of range: %2f", longitude);
         return;
     }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreSettings();
     _latitude = latitude;
     _longitude = longitude;
+    xSemaphoreGive(_mutex);
 }
 
-void NonVolatileStorage::getGeoLocation(float &latitude, float &longitude) const
+void NonVolatileStorage::getGeoLocation(float &latitude, float &longitude)
 {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreSettings();
     latitude = _latitude;
     longitude = _longitude;
+    xSemaphoreGive(_mutex);
 }
 
-void NonVolatileStorage::getFixOpeningTime(uint8_t& hour, uint8_t& minutes) const
+void NonVolatileStorage::getFixOpeningTime(uint8_t& hour, uint8_t& minutes)
 {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreSettings();
     hour = _fixOpeningTime_hour;
     minutes = _fixOpeningTime_minute;
+    xSemaphoreGive(_mutex);
 }
 
-void NonVolatileStorage::setFixOpeningTime(const String hour_minutes)
+void NonVolatileStorage::setFixOpeningTime(uint8_t hour, uint8_t minutes)
 {
-    uint8_t hour = 0;
-    uint8_t minutes = 0;
-    ESP_LOGI(TAG, "Setting fix opening time to %s", hour_minutes.c_str());
-    if (parseTimeString(hour_minutes, hour, minutes))
+    if (hour > 23 || minutes > 59)
     {
-        _fixOpeningTime_hour = hour;
-        _fixOpeningTime_minute = minutes;
-        ESP_LOGI(TAG, "Fix opening time set to %02d:%02d", hour, minutes);
+        ESP_LOGE(TAG, "Invalid opening time: %d:%d", hour, minutes);
+        return;
     }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreSettings();
+    _fixOpeningTime_hour = hour;
+    _fixOpeningTime_minute = minutes;
+    xSemaphoreGive(_mutex);
+    ESP_LOGI(TAG, "Fix opening time set to %02d:%02d", hour, minutes);
 }
 
-void NonVolatileStorage::getFixClosingTime(uint8_t& hour, uint8_t& minutes) const
+void NonVolatileStorage::getFixClosingTime(uint8_t& hour, uint8_t& minutes)
 {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreSettings();
     hour = _fixClosingTime_hour;
     minutes = _fixClosingTime_minute;
+    xSemaphoreGive(_mutex);
 }
-void NonVolatileStorage::setFixClosingTime(const String hour_minutes)
+void NonVolatileStorage::setFixClosingTime(uint8_t hour, uint8_t minutes)
 {
-    uint8_t hour = 0;
-    uint8_t minutes = 0;
-    if (parseTimeString(hour_minutes, hour, minutes))
+    if (hour > 23 || minutes > 59)
     {
-        _fixClosingTime_hour = hour;
-        _fixClosingTime_minute = minutes;
-        ESP_LOGI(TAG, "Fix closing time set to %02d:%02d", hour, minutes);
+        ESP_LOGE(TAG, "Invalid closing time: %d:%d", hour, minutes);
+        return;
     }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreSettings();
+    _fixClosingTime_hour = hour;
+    _fixClosingTime_minute = minutes;
+    xSemaphoreGive(_mutex);
+    ESP_LOGI(TAG, "Fix closing time set to %02d:%02d", hour, minutes);
 }
 
-NonVolatileStorage::DoorControl NonVolatileStorage::getDoorControl() const { return _doorControl; }
+NonVolatileStorage::DoorControl NonVolatileStorage::getDoorControl()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreSettings();
+    DoorControl doorControl = _doorControl;
+    xSemaphoreGive(_mutex);
+    return doorControl;
+}
+
+void NonVolatileStorage::setDoorControl(DoorControl doorControl)
+{
+    if (doorControl != DoorControl::Manual && doorControl != DoorControl::FixTime && doorControl != DoorControl::SunriseSunset)
+    {
+        ESP_LOGE(TAG, "Invalid door control: %d", static_cast<int>(doorControl));
+        return;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreSettings();
+    _doorControl = doorControl;
+    xSemaphoreGive(_mutex);
+}
 
 /**
- * @brief Set the Door Control object
- * The fixed strings are the same as defined in index.js
- * @param doorControl
+ * @brief Set the time zone, names that don't fit are refused
  */
-void NonVolatileStorage::setDoorControl(const String doorControl)
+void NonVolatileStorage::setTimeZone(const char *timeZone)
 {
-    if (doorControl.equals("manual"))
+    if (timeZone == nullptr || strlen(timeZone) > MAX_TIME_ZONE_LENGTH)
     {
-        _doorControl = DoorControl::Manual;
+        ESP_LOGE(TAG, "Invalid time zone");
+        return;
     }
-    else if (doorControl.equals("fixedTime"))
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreTimeZone();
+    if (strcmp(timeZone, _timeZone) != 0)
     {
-        _doorControl = DoorControl::FixTime;
+        strlcpy(_timeZone, timeZone, sizeof(_timeZone));
+        _timeZoneChanged = true;
     }
-    else if (doorControl.equals("sun"))
+    xSemaphoreGive(_mutex);
+}
+
+/**
+ * @brief Get the time zone, it's read from NVS at the first call.
+ * @details The name stays valid until the next setTimeZone(), which is only called by the scheduler task, like the users of
+ * the time zone.
+ */
+const char *NonVolatileStorage::getTimeZone()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    restoreTimeZone();
+    xSemaphoreGive(_mutex);
+    return _timeZone;
+}
+
+/**
+ * @brief Read the time zone at the first access.  Called with the mutex taken.
+ */
+void NonVolatileStorage::restoreTimeZone()
+{
+    if (_timeZoneRestored)
     {
-        _doorControl = DoorControl::SunriseSunset;
+        return;
     }
-    else
+    unsigned long startTime = micros();
+    if (open())
     {
-        ESP_LOGE(TAG, "Invalid door control: %s", doorControl.c_str());
-        return;
+        getString(NVS_KEY_TIME_ZONE, _timeZone, sizeof(_timeZone), "");
     }
+    _readTimes.timeZone_us = micros() - startTime;
+    _timeZoneRestored = true;
+    ESP_LOGI(TAG, "Time zone restored in %lu us", (unsigned long)_readTimes.timeZone_us);
 }
 
-void NonVolatileStorage::setTimeZone(const String timeZone)
-{
-    _timeZone = timeZone;
-}
-
-String NonVolatileStorage::getTimeZone() const
+/**
+ * @brief Parse the door control names of the JSON configuration message
+ * The fixed strings are the same as the ones of the web pages before the binary configuration message
+ * @param name
+ * @param doorControl
+ * @return true when the name is valid
+ */
+bool NonVolatileStorage::parseDoorControl(const char *name, DoorControl &doorControl)
 {
-    return _timeZone;
+    if (name == nullptr)
+    {
+        ESP_LOGE(TAG, "No door control");
+        return false;
+    }
+    if (strcmp(name, "manual") == 0)
+    {
+        doorControl = DoorControl::Manual;
+    }
+    else if (strcmp(name, "fixedTime") == 0)
+    {
+        doorControl = DoorControl::FixTime;
+    }
+    else if (strcmp(name, "sun") == 0)
+    {
+        doorControl = DoorControl::SunriseSunset;
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Invalid door control: %s", name);
+        return false;
+    }
+    return true;
 }
 
-bool NonVolatileStorage::parseTimeString(const String hour_minutes, uint8_t &hour, uint8_t &minutes)
+/**
+ * @brief Parse "hh:mm"
+ */
+bool NonVolatileStorage::parseTimeString(const char *hour_minutes, uint8_t &hour, uint8_t &minutes)
 {
-    if (hour_minutes.length() != 5)
+    if (hour_minutes == nullptr || strlen(hour_minutes) != 5 || !isdigit(hour_minutes[0]) || !isdigit(hour_minutes[1]) ||
+        !isdigit(hour_minutes[3]) || !isdigit(hour_minutes[4]))
     {
-        ESP_LOGE(TAG, "Invalid time string: %s", hour_minutes.c_str());
+        ESP_LOGE(TAG, "Invalid time string: %s", hour_minutes ? hour_minutes : "");
         return false;
     }
-    hour = hour_minutes.substring(0, 2).toInt();
-    minutes = hour_minutes.substring(3, 5).toInt();
+    hour = (hour_minutes[0] - '0') * 10 + (hour_minutes[1] - '0');
+    minutes = (hour_minutes[3] - '0') * 10 + (hour_minutes[4] - '0');
     if (hour > 23)
     {
         ESP_LOGE(TAG, "Hour out of range: %d", hour);
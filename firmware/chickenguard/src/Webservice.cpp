@@ -1,21 +1,79 @@
 #include "Webservice.h"
-#include <SPIFFS.h>
+#include "NonVolatileStorage.h"
+#include <esp_heap_caps.h>
 
 #include <ArduinoJson.h>
 #include "wifi_credentials.h"
+#include "motorTrace.h"
+#include "traceLog.h"
+#include "webUi.h"
 
 static const char *TAG = "Webservice";
 static Webservice *_instance = nullptr;
 
-static String processor(const String &var)
+/**
+ * @brief Send the web UI, bundled and gzipped into the firmware by tools/compress_web.py.  It's sent straight from flash.
+ * The page must be revalidated at each load, which only costs a 304 when the firmware hasn't changed.
+ */
+static void onRootRequest(AsyncWebServerRequest *request)
 {
-    return String(var == "STATE" ? "on" : "off");
+    AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+    AsyncWebServerResponse *response;
+    if (ifNoneMatch != nullptr && ifNoneMatch->value() == WebUi::ETAG)
+    {
+        response = request->beginResponse(304);
+    }
+    else
+    {
+        response = request->beginResponse_P(200, "text/html", WebUi::PAGE, WebUi::PAGE_SIZE);
+        response->addHeader("Content-Encoding", "gzip");
+    }
+    response->addHeader("ETag", WebUi::ETAG);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
 }
 
-static void onRootRequest(AsyncWebServerRequest *request)
+/**
+ * @brief Download the traces of the last motor runs as a binary blob.  Decode with tools/decode_trace.py
+ */
+static void onTraceRequest(AsyncWebServerRequest *request)
 {
-    AsyncWebServerResponse *response = request->beginResponse(SPIFFS, "/index.html", "text/html", false, processor);
-    response->addHeader("Cache-Control", "public,max-age=0"); //
+    AsyncResponseStream *response = request->beginResponseStream("application/octet-stream");
+    response->addHeader("Content-Disposition", "attachment; filename=\"trace.bin\"");
+    MotorTrace::dump(*response);
+    request->send(response);
+}
+
+/**
+ * @brief Show the trace log as text.  The records are only formatted here.
+ */
+static void onLogRequest(AsyncWebServerRequest *request)
+{
+    AsyncResponseStream *response = request->beginResponseStream("text/plain");
+    TraceLog::dump(*response);
+    request->send(response);
+}
+
+/**
+ * @brief Report the unit status as JSON, for scripts.  The JSON is written piece by piece into the response, without a document.
+ * @details The time to build the response is returned in a Server-Timing header.  The heap taken by the response, which holds the
+ * JSON until it has been sent, is logged.  Instrumentation only : neither has been measured on the board yet.
+ */
+static void onStatusRequest(AsyncWebServerRequest *request)
+{
+    uint32_t start = micros();
+    size_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    AsyncResponseStream *response = request->beginResponseStream("application/json", 512);
+    _instance->printStatus(*response);
+    // Other tasks may allocate meanwhile, so it's an estimate
+    int heapUsed = static_cast<int>(freeHeap - heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    uint32_t duration = micros() - start;
+    char timing[32];
+    snprintf(timing, sizeof(timing), "status;dur=%lu.%03lu", static_cast<unsigned long>(duration / 1000),
+             static_cast<unsigned long>(duration % 1000));
+    response->addHeader("Server-Timing", timing);
+    response->addHeader("Cache-Control", "no-store");
+    ESP_LOGI(TAG, "Status: %lu us, %d bytes of heap", static_cast<unsigned long>(duration), heapUsed);
     request->send(response);
 }
 
@@ -31,12 +89,14 @@ static void onEvent(AsyncWebSocket *server,
     {
     case WS_EVT_CONNECT:
         ESP_LOGI(TAG, "WebSocket client #%u connected from %s\n", client->id(), client->remoteIP().toString().c_str());
+        _instance->onClientConnected(client->id());
         break;
     case WS_EVT_DISCONNECT:
         ESP_LOGI(TAG, "WebSocket client #%u disconnected\n", client->id());
+        _instance->onClientDisconnected(client->id());
         break;
     case WS_EVT_DATA:
-        _instance->handleWebSocketMessage(arg, data, len);
+        _instance->handleWebSocketMessage(client->id(), arg, data, len);
         break;
     case WS_EVT_PONG:
     case WS_EVT_ERROR:
@@ -44,14 +104,22 @@ static void onEvent(AsyncWebSocket *server,
     }
 }
 
-Webservice::Webservice(NonVolatileStorage *nonVolatileStorage, void (*updateTime)(long utc, const String timezone),
-                       void (*cbDataReceived)(void)) : localIP(4, 3, 2, 1),
-                                                       subnetMask(255, 255, 255, 0),
-                                                       server(80),
-                                                       ws("/ws"),
-                                                       _nonVolatileStorage(nonVolatileStorage),
-                                                       _updateTime(updateTime),
-                                                       _cbDataReceived(cbDataReceived)
+/**
+ * @brief Construct a new Webservice object
+ *
+ * @param eventLog
+ * @param configReceived called in the async_tcp task with the configuration of a client, it must copy it and return quickly.
+ *  Returns false when the configuration couldn't be handed over.
+ * @param printStatus writes the status of the unit as JSON
+ */
+Webservice::Webservice(EventLog *eventLog, bool (*configReceived)(const WsProtocol::Config &config),
+                       void (*printStatus)(Print &output)) : localIP(4, 3, 2, 1),
+                                                             subnetMask(255, 255, 255, 0),
+                                                             server(80),
+                                                             ws("/ws"),
+                                                             _eventLog(eventLog),
+                                                             _configReceived(configReceived),
+                                                             _printStatus(printStatus)
 {
     _instance = this;
 }
@@ -64,11 +132,9 @@ void Webservice::setup()
 {
     if(isInitialized)
         return;
-    if (!SPIFFS.begin())
+    if (_clientsMutex == nullptr)
     {
-        ESP_LOGE(TAG, "Cannot mount SPIFFS volume...be sure to upload Filesystem Image before uploading the sketch");
-        while (1)
-            ;
+        _clientsMutex = xSemaphoreCreateMutexStatic(&_clientsMutexBuffer);
     }
 
 #ifdef WIFI_STATION
@@ -89,21 +155,49 @@ void Webservice::setup()
     dnsServer.setTTL(300);             // set 5min client side cache for DNS
     dnsServer.start(53, "*", localIP); // if DNSServer is started with "*" for domain name, it will reply with provided IP to all DNS request
 #endif
-    ws.onEvent(onEvent);
-    server.addHandler(&ws);
-    server.on("/favicon.ico", [](AsyncWebServerRequest *request)
-              { request->send(404); }); // webpage icon
+    if (!_handlersAdded)
+    {
+        ws.onEvent(onEvent);
+        server.addHandler(&ws);
+        server.on("/favicon.ico", [](AsyncWebServerRequest *request)
+                  { request->send(404); }); // webpage icon
 
-    // the catch all
-    server.onNotFound([](AsyncWebServerRequest *request)
-                      { request->redirect("http://4.3.2.1"); }); //// a string version of the local IP with http, used for redirecting clients to your webpage
+        // the catch all
+        server.onNotFound([](AsyncWebServerRequest *request)
+                          { request->redirect("http://4.3.2.1"); }); //// a string version of the local IP with http, used for redirecting clients to your webpage
 
-    server.on("/", HTTP_ANY, onRootRequest);
-    server.serveStatic("/", SPIFFS, "/");
+        server.on("/", HTTP_GET, onRootRequest);
+        server.on("/trace", HTTP_GET, onTraceRequest);
+        server.on("/log", HTTP_GET, onLogRequest);
+        server.on("/status", HTTP_GET, onStatusRequest);
+        _handlersAdded = true;
+    }
     server.begin();
     isInitialized = true;
 }
 
+/**
+ * @brief Close the clients, stop the webserver and turn WiFi off.  Used to release the heap before it runs out.
+ * setup() can start the webserver again.
+ */
+void Webservice::stop()
+{
+    if (!isInitialized)
+    {
+        return;
+    }
+    isInitialized = false;
+    ws.closeAll();
+    ws.cleanupClients(0);
+    server.end();
+#ifndef WIFI_STATION
+    dnsServer.stop();
+    WiFi.softAPdisconnect(true);
+#endif
+    WiFi.mode(WIFI_OFF);
+    ESP_LOGW(TAG, "Webserver stopped");
+}
+
 void Webservice::loop()
 {
     if (!isInitialized)
@@ -112,74 +206,394 @@ void Webservice::loop()
     }
     dnsServer.processNextRequest();
     ws.cleanupClients();
+    flushStatus();
+}
+
+/**
+ * @brief Serialize {"key": key, "status": status}
+ *
+ * @return size_t length of the JSON text
+ */
+static size_t toJson(const char *key, const char *status, char *buffer, size_t size)
+{
+    StaticJsonDocument<JSON_OBJECT_SIZE(2)> json;
+    json["key"] = key;
+    json["status"] = status;
+    return serializeJson(json, buffer, size);
 }
 
-void Webservice::notifyClients(String key, String status)
+void Webservice::notifyClients(const char *key, const char *status)
 {
     if (!isInitialized || !ws.count())
     {
         return;
     }
-    ESP_LOGI(TAG, "Notify: key: %s, status: %s", key.c_str(), status.c_str());
-    const uint8_t size = JSON_OBJECT_SIZE(3);
-    StaticJsonDocument<size> json;
-    json["key"] = key.c_str();
-    if (key.equals("feedback"))
+    char buffer[80];
+    size_t len = toJson(key, status, buffer, sizeof(buffer));
+    TRACE(WEB, DEBUG, Notify, len, ws.count());
+    ws.textAll(buffer, len);
+}
+
+/**
+ * @brief Publish the status, when it differs enough from the last published status.
+ * @details Only records the values, flushStatus() sends them.  Values published within STATUS_MIN_INTERVAL after the last message to
+ * a client are merged in a single message to that client.  Called from the network task, like loop().
+ */
+void Webservice::publishStatus(uint8_t batteryPercent, uint32_t freeHeap, uint32_t largestBlock)
+{
+    if (!isInitialized)
+    {
+        return;
+    }
+    uint8_t changed = 0;
+    if (!_statusValid || abs(batteryPercent - _status.batteryPercent) >= BATTERY_THRESHOLD)
     {
-        json["status"] = status.c_str();
+        _status.batteryPercent = batteryPercent;
+        changed |= STATUS_BATTERY;
     }
-    if (key.equals("battery"))
+    if (!_statusValid || abs(static_cast<int32_t>(freeHeap - _status.freeHeap)) >= static_cast<int32_t>(HEAP_THRESHOLD) ||
+        abs(static_cast<int32_t>(largestBlock - _status.largestBlock)) >= static_cast<int32_t>(HEAP_THRESHOLD))
     {
-        json["status"] = status.c_str();
+        _status.freeHeap = freeHeap;
+        _status.largestBlock = largestBlock;
+        changed |= STATUS_HEAP;
     }
+    _statusValid = true;
+    xSemaphoreTake(_clientsMutex, portMAX_DELAY);
+    for (Client &client : _clients)
+    {
+        if (client.id != 0)
+        {
+            client.pendingStatus |= changed;
+        }
+    }
+    xSemaphoreGive(_clientsMutex);
+}
 
-    char buffer[size + 10];
-    size_t len = serializeJson(json, buffer);
-    ESP_LOGI(TAG, "json: %s", buffer);
-    ws.textAll(buffer, len);
+/**
+ * @brief Send the pending status to each client : as a binary message to the clients that have sent Hello, as JSON to the other
+ * clients, only with the changed keys.
+ * Each client gets at most one status message per STATUS_MIN_INTERVAL.  A client whose send queue is full keeps its status
+ * pending, so it gets the latest values once it has caught up.
+ * The slots are copied under the mutex and the messages are sent without it.
+ */
+void Webservice::flushStatus()
+{
+    if (!_statusValid)
+    {
+        return;
+    }
+    uint32_t now = millis();
+    struct Pending
+    {
+        uint32_t id;
+        bool binary;
+        uint8_t pendingStatus;
+    } clients[MAX_CLIENTS];
+    size_t count = 0;
+    xSemaphoreTake(_clientsMutex, portMAX_DELAY);
+    for (const Client &client : _clients)
+    {
+        if (client.id != 0 && client.pendingStatus != 0 && now - client.lastSent >= STATUS_MIN_INTERVAL)
+        {
+            clients[count++] = {client.id, client.binary, client.pendingStatus};
+        }
+    }
+    xSemaphoreGive(_clientsMutex);
+
+    _status.header = {static_cast<uint8_t>(WsProtocol::MessageType::Status), WsProtocol::VERSION};
+    // Only serialized when there's a JSON client
+    char battery[48];
+    char heap[80];
+    size_t batteryLength = 0;
+    size_t heapLength = 0;
+    size_t sent = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        Pending &client = clients[i];
+        if (!ws.availableForWrite(client.id))
+        {
+            // Nothing sent, so nothing is cleared below : the status stays pending
+            client.pendingStatus = 0;
+            continue;
+        }
+        if (client.binary)
+        {
+            ws.binary(client.id, reinterpret_cast<uint8_t *>(&_status), sizeof(_status));
+        }
+        else
+        {
+            if (batteryLength == 0)
+            {
+                char text[48];
+                snprintf(text, sizeof(text), "%u%%", _status.batteryPercent);
+                batteryLength = toJson("battery", text, battery, sizeof(battery));
+                snprintf(text, sizeof(text), "%lu bytes free, largest block %lu", static_cast<unsigned long>(_status.freeHeap),
+                         static_cast<unsigned long>(_status.largestBlock));
+                heapLength = toJson("heap", text, heap, sizeof(heap));
+            }
+            if (client.pendingStatus & STATUS_BATTERY)
+            {
+                ws.text(client.id, battery, batteryLength);
+            }
+            if (client.pendingStatus & STATUS_HEAP)
+            {
+                ws.text(client.id, heap, heapLength);
+            }
+        }
+        sent++;
+    }
+    // Only the keys that have been sent are cleared : a client that sent Hello meanwhile still gets the full status
+    xSemaphoreTake(_clientsMutex, portMAX_DELAY);
+    for (size_t i = 0; i < count; i++)
+    {
+        Client *client = findClient(clients[i].id);
+        if (client != nullptr && clients[i].pendingStatus != 0)
+        {
+            client->pendingStatus &= ~clients[i].pendingStatus;
+            client->lastSent = now;
+        }
+    }
+    xSemaphoreGive(_clientsMutex);
+    if (sent > 0)
+    {
+        TRACE(WEB, DEBUG, Notify, sizeof(_status), sent);
+    }
 }
 
-void Webservice::handleWebSocketMessage(void *arg, uint8_t *data, size_t len)
+void Webservice::onClientConnected(uint32_t clientId)
 {
-    AwsFrameInfo *info = (AwsFrameInfo *)arg;
-    if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT)
+    // Only assigned in this task, so the slot can be searched without the mutex
+    Client *client = findClient(0);
+    if (client == nullptr)
+    {
+        // AsyncWebSocket closes the clients beyond DEFAULT_MAX_WS_CLIENTS at the next cleanupClients()
+        ESP_LOGW(TAG, "No room for client #%u", clientId);
+        return;
+    }
+    client->reassembler.reset();
+    xSemaphoreTake(_clientsMutex, portMAX_DELAY);
+    client->id = clientId;
+    client->binary = false;
+    // A new client gets the full status, right away
+    client->pendingStatus = STATUS_ALL;
+    client->lastSent = millis() - STATUS_MIN_INTERVAL;
+    xSemaphoreGive(_clientsMutex);
+}
+
+void Webservice::onClientDisconnected(uint32_t clientId)
+{
+    Client *client = findClient(clientId);
+    if (client != nullptr)
     {
+        xSemaphoreTake(_clientsMutex, portMAX_DELAY);
+        client->id = 0;
+        client->binary = false;
+        client->pendingStatus = 0;
+        xSemaphoreGive(_clientsMutex);
+        client->reassembler.reset();
+    }
+}
 
-        const uint8_t size = JSON_OBJECT_SIZE(7);
-        StaticJsonDocument<size> json;
-        char buffer[len + 1];
-        memcpy(buffer, data, len);
-        buffer[len] = '\0';
-        Serial.println(buffer);
-        DeserializationError err = deserializeJson(json, data);
-        if (err)
+/**
+ * @brief The slot of a client.  The network task must hold the mutex, the async_tcp task assigns the slots so it doesn't need it.
+ */
+Webservice::Client *Webservice::findClient(uint32_t clientId)
+{
+    for (Client &client : _clients)
+    {
+        if (client.id == clientId)
         {
-            ESP_LOGE(TAG, "deserializeJson() failed with code %s", err.c_str());
-            notifyClients("feedback", "error");
-            return;
+            return &client;
         }
+    }
+    return nullptr;
+}
 
-        // Update time
-        long utc = json["UTCSeconds"];
-        String timeZone = json["Timezone"];
-        _updateTime(utc, timeZone);
+/**
+ * @brief Send a binary frame to all clients, unless a client can't keep up.
+ * @details The frame is dropped instead of being queued when the send queue of a client is full or when the heap is running low.
+ * Queued messages are allocated on the heap, so the queues must not be allowed to grow when the WiFi link is slow.
+ * @return true when the frame has been sent
+ */
+bool Webservice::sendBinary(const uint8_t *data, size_t len)
+{
+    const size_t MIN_FREE_BLOCK = 8192;
+    if (!isInitialized || !ws.count())
+    {
+        return false;
+    }
+    if (!ws.availableForWriteAll() || heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < len + MIN_FREE_BLOCK)
+    {
+        if ((_droppedFrames++ % 20) == 0)
+        {
+            ESP_LOGW(TAG, "Clients can't keep up, %lu frames dropped", static_cast<unsigned long>(_droppedFrames));
+        }
+        return false;
+    }
+    ws.binaryAll(const_cast<uint8_t *>(data), len);
+    return true;
+}
 
-        // Update location
-        float latitude = json["Latitude"];
-        float longitude = json["Longitude"];
-        _nonVolatileStorage->setGeoLocation(latitude, longitude);
+/**
+ * @brief Send one page of the event log, newest runs first, to the client that asked for it.
+ * @details Each run is an array : [utc, source, opening, stop reason, peak current, battery mV, travel time in 0.1s].  Arrays instead of
+ * objects keep the message and the JSON document small enough for the stack.
+ */
+void Webservice::sendEventLogPage(uint32_t clientId, size_t page)
+{
+    EventLog::Record records[EVENT_LOG_PAGE_SIZE];
+    size_t count = _eventLog->read(page * EVENT_LOG_PAGE_SIZE, records, EVENT_LOG_PAGE_SIZE);
+    const size_t size = JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(EVENT_LOG_PAGE_SIZE) + EVENT_LOG_PAGE_SIZE * JSON_ARRAY_SIZE(7);
+    StaticJsonDocument<size> json;
+    json["key"] = "eventlog";
+    json["page"] = page;
+    json["total"] = _eventLog->getCount();
+    JsonArray runs = json.createNestedArray("records");
+    for (size_t i = 0; i < count; i++)
+    {
+        const EventLog::Record &record = records[i];
+        JsonArray run = runs.createNestedArray();
+        run.add(record.utc);
+        run.add(static_cast<uint8_t>(EventLog::getSource(record)));
+        run.add(EventLog::isOpening(record));
+        run.add(EventLog::getStopReason(record));
+        run.add(record.peakCurrent);
+        run.add(record.battery_mV);
+        run.add(record.travelTime_ds);
+    }
+    char buffer[EVENT_LOG_PAGE_SIZE * 48 + 80];
+    size_t len = serializeJson(json, buffer);
+    ws.text(clientId, buffer, len);
+}
 
-        // Update door control
-        String doorControl = json["DoorControl"];
-        _nonVolatileStorage->setDoorControl(doorControl);
+/**
+ * @brief Handle a piece of a websocket message : text messages are JSON, binary messages are defined in wsProtocol.h
+ * @details Fragmented messages are reassembled per client.  The client is told when its message can't be handled.
+ */
+void Webservice::handleWebSocketMessage(uint32_t clientId, void *arg, uint8_t *data, size_t len)
+{
+    AwsFrameInfo *info = (AwsFrameInfo *)arg;
+    Client *client = findClient(clientId);
+    if (client == nullptr)
+    {
+        return;
+    }
+    WsReassembler &reassembler = client->reassembler;
+    switch (reassembler.feed(info->opcode, info->final, info->len, info->index, data, len))
+    {
+    case WsReassembler::Result::Incomplete:
+        return;
+    case WsReassembler::Result::Complete:
+        break;
+    case WsReassembler::Result::TooLarge:
+        ESP_LOGW(TAG, "Message of client #%u exceeds %u bytes", clientId, (unsigned)WsReassembler::MAX_MESSAGE_SIZE);
+        sendFeedback(clientId, "message too large");
+        return;
+    case WsReassembler::Result::Malformed:
+        ESP_LOGW(TAG, "Malformed message from client #%u: opcode %u, frame index %llu", clientId, info->opcode,
+                 static_cast<unsigned long long>(info->index));
+        sendFeedback(clientId, "malformed message");
+        return;
+    }
+    if (reassembler.getOpcode() == WsReassembler::OPCODE_TEXT)
+    {
+        handleJsonMessage(clientId, reinterpret_cast<char *>(reassembler.getMessage()), reassembler.getLength());
+    }
+    else
+    {
+        handleBinaryMessage(clientId, reassembler.getMessage(), reassembler.getLength());
+    }
+}
+
+void Webservice::sendFeedback(uint32_t clientId, const char *status)
+{
+    char buffer[80];
+    size_t len = toJson("feedback", status, buffer, sizeof(buffer));
+    ws.text(clientId, buffer, len);
+}
+
+void Webservice::handleBinaryMessage(uint32_t clientId, const uint8_t *data, size_t len)
+{
+    if (len < sizeof(WsProtocol::Header))
+    {
+        return;
+    }
+    if (WsProtocol::isMessage(data, len, WsProtocol::MessageType::Hello, sizeof(WsProtocol::Header)))
+    {
+        Client *client = findClient(clientId);
+        if (client != nullptr)
+        {
+            xSemaphoreTake(_clientsMutex, portMAX_DELAY);
+            client->binary = true;
+            client->pendingStatus = STATUS_ALL;
+            xSemaphoreGive(_clientsMutex);
+        }
+        return;
+    }
+    if (WsProtocol::isMessage(data, len, WsProtocol::MessageType::Config, sizeof(WsProtocol::Config)))
+    {
+        // Packed, so it can be used in place
+        applyConfig(*reinterpret_cast<const WsProtocol::Config *>(data));
+        return;
+    }
+    ESP_LOGW(TAG, "Unknown binary message: type %u, version %u, %u bytes", data[0], data[1], (unsigned)len);
+}
+
+/**
+ * @brief The JSON messages of the web pages before the binary protocol
+ */
+void Webservice::handleJsonMessage(uint32_t clientId, char *data, size_t len)
+{
+    StaticJsonDocument<JSON_OBJECT_SIZE(7)> json;
+    // The strings point into the message : deserializeJson() doesn't copy them from a writable input
+    DeserializationError err = deserializeJson(json, data, len);
+    if (err)
+    {
+        ESP_LOGE(TAG, "deserializeJson() failed with code %s", err.c_str());
+        notifyClients("feedback", "error");
+        return;
+    }
+    if (json.containsKey("EventLogPage"))
+    {
+        sendEventLogPage(clientId, json["EventLogPage"]);
+        return;
+    }
 
-        // Update automatic opening and closing time
-        String fixOpeningTime = json["AutomaticOpeningTime"];
-        String fixClosingTime = json["AutomaticClosingTime"];
-        _nonVolatileStorage->setFixOpeningTime(fixOpeningTime);
-        _nonVolatileStorage->setFixClosingTime(fixClosingTime);
+    // Same content as the binary message.  Values that don't parse are out of range, so that the settings keep their value.
+    WsProtocol::Config config = {};
+    config.utc = json["UTCSeconds"];
+    strlcpy(config.timeZone, json["Timezone"] | "", sizeof(config.timeZone));
+    config.latitude = json["Latitude"];
+    config.longitude = json["Longitude"];
+    NonVolatileStorage::DoorControl doorControl;
+    config.doorControl = NonVolatileStorage::parseDoorControl(json["DoorControl"], doorControl) ? static_cast<uint8_t>(doorControl) : UINT8_MAX;
+    uint8_t hour;
+    uint8_t minutes;
+    config.openHour = UINT8_MAX;
+    if (NonVolatileStorage::parseTimeString(json["AutomaticOpeningTime"], hour, minutes))
+    {
+        config.openHour = hour;
+        config.openMinute = minutes;
+    }
+    config.closeHour = UINT8_MAX;
+    if (NonVolatileStorage::parseTimeString(json["AutomaticClosingTime"], hour, minutes))
+    {
+        config.closeHour = hour;
+        config.closeMinute = minutes;
+    }
+    applyConfig(config);
+}
 
-        notifyClients("feedback", "Data received");
-        _cbDataReceived();
+/**
+ * @brief Hand the configuration over to the scheduler task, which stores it.  No settings are changed in the async_tcp task.
+ */
+void Webservice::applyConfig(const WsProtocol::Config &config)
+{
+    if (!_configReceived(config))
+    {
+        notifyClients("feedback", "error: busy, please submit again");
+        return;
     }
-}
\ No newline at end of file
+    notifyClients("feedback", "Data received");
+}
@@ -0,0 +1,314 @@
+#include "adcScanner.h"
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#include <esp_task.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const char *TAG = "AdcScanner";
+
+static const uint32_t SAMPLE_FREQUENCY = 3000;                                            //!< Conversions per second, shared by all channels
+static const uint32_t CONVERSIONS_PER_FRAME = 30;                                         //!< One DMA frame every 10ms
+static const uint32_t FRAME_SIZE = CONVERSIONS_PER_FRAME * SOC_ADC_DIGI_RESULT_BYTES;
+static const adc_atten_t ATTENUATION = ADC_ATTEN_DB_11;                                   //!< Same as analogRead() : 0..2500mV
+static const uint32_t TASK_STACK_SIZE = 2560;
+static const UBaseType_t TASK_PRIORITY = ESP_TASK_TIMER_PRIO + 1;                         //!< Above all readers, see AdcScanner::Slot
+
+static esp_adc_cal_characteristics_t adcCharacteristics;
+static StaticTask_t taskBuffer;
+static StackType_t taskStack[TASK_STACK_SIZE];
+
+AdcScanner::AdcScanner()
+{
+}
+
+AdcScanner::~AdcScanner()
+{
+}
+
+/**
+ * @brief Add a channel to the scan
+ *
+ * @param pin analog input pin, must be on ADC1
+ * @param period_ms period at which the filtered value is published
+ * @param maxValid_mV conversions at or above this voltage are rejected, as well as saturated conversions.  0 for no limit
+ * @return true when successful
+ */
+bool AdcScanner::addChannel(uint8_t pin, uint16_t period_ms, uint16_t maxValid_mV)
+{
+    int8_t adcChannel = digitalPinToAnalogChannel(pin);
+    if (_running || _channelCount >= MAX_CHANNELS || adcChannel < 0 || adcChannel >= SOC_ADC_CHANNEL_NUM(0) || period_ms == 0)
+    {
+        ESP_LOGE(TAG, "Can't add pin %u", pin);
+        return false;
+    }
+    Channel &channel = _channels[_channelCount++];
+    channel.pin = pin;
+    channel.adcChannel = adcChannel;
+    channel.period_ms = period_ms;
+    channel.maxValid_mV = maxValid_mV;
+    channel.maxValidRaw = UINT16_MAX;
+    channel.sampleCount = 0;
+    channel.validCount = 0;
+    channel.sum = 0;
+    channel.reading = {};
+    return true;
+}
+
+/**
+ * @brief Start the scan of all channels that have been added
+ *
+ * @return true when successful
+ */
+bool AdcScanner::begin()
+{
+    if (_running || _channelCount == 0)
+    {
+        return false;
+    }
+    if (esp_adc_cal_check_efuse(ESP_ADC_CAL_VAL_EFUSE_TP) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "No eFuse calibration, using the default curve");
+    }
+    esp_adc_cal_characterize(ADC_UNIT_1, ATTENUATION, ADC_WIDTH_BIT_12, 0, &adcCharacteristics);
+
+    uint32_t channelMask = 0;
+    adc_digi_pattern_config_t pattern[MAX_CHANNELS] = {};
+    for (size_t i = 0; i < _channelCount; i++)
+    {
+        Channel &channel = _channels[i];
+        // The channels are converted round robin
+        channel.samplesPerPeriod = channel.period_ms * SAMPLE_FREQUENCY / (1000 * _channelCount);
+        if (channel.samplesPerPeriod == 0)
+        {
+            channel.samplesPerPeriod = 1;
+        }
+        if (channel.maxValid_mV > 0)
+        {
+            channel.maxValidRaw = maxRaw(channel.maxValid_mV);
+        }
+        channelMask |= BIT(channel.adcChannel);
+        pattern[i].atten = ATTENUATION;
+        pattern[i].channel = channel.adcChannel;
+        pattern[i].unit = ADC_NUM_1;
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+
+    adc_digi_init_config_t initConfig = {};
+    initConfig.max_store_buf_size = 4 * FRAME_SIZE;
+    initConfig.conv_num_each_intr = FRAME_SIZE;
+    initConfig.adc1_chan_mask = channelMask;
+    initConfig.adc2_chan_mask = 0;
+    if (adc_digi_initialize(&initConfig) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't initialize the ADC");
+        return false;
+    }
+
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = false;
+    config.pattern_num = _channelCount;
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = SAMPLE_FREQUENCY;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+    if (adc_digi_controller_configure(&config) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't configure the ADC");
+        adc_digi_deinitialize();
+        return false;
+    }
+    if (adc_digi_start() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't start the ADC");
+        adc_digi_deinitialize();
+        return false;
+    }
+    _running = true;
+    xTaskCreateStatic(&AdcScanner::task, "adcScanner", TASK_STACK_SIZE, this, TASK_PRIORITY, taskStack, &taskBuffer);
+    return true;
+}
+
+/**
+ * @brief Stop the conversions.  The scanner task keeps waiting for the next DMA frame.
+ * @details pause() and resume() must be called from a single task.
+ * @return true when successful
+ */
+bool AdcScanner::pause()
+{
+    if (!_running || _paused)
+    {
+        return _running;
+    }
+    if (adc_digi_stop() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't stop the ADC");
+        return false;
+    }
+    _paused = true;
+    return true;
+}
+
+/**
+ * @brief Restart the conversions after pause()
+ *
+ * @return true when successful
+ */
+bool AdcScanner::resume()
+{
+    if (!_running || !_paused)
+    {
+        return _running;
+    }
+    if (adc_digi_start() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't restart the ADC");
+        return false;
+    }
+    _paused = false;
+    return true;
+}
+
+/**
+ * @brief Get the latest reading of a channel.  Never blocks.
+ *
+ * @param pin
+ * @param reading
+ * @return true when the reading is valid, false when the channel doesn't exist or has no data yet.
+ */
+bool AdcScanner::getReading(uint8_t pin, Reading &reading)
+{
+    Channel *channel = findChannel(pin);
+    return channel != nullptr && channel->slot.read(reading) && reading.count > 0;
+}
+
+/**
+ * @brief Wait until a channel has published its first filtered value.  Only intended for use at startup.
+ *
+ * @return true when the reading is valid, false on timeout
+ */
+bool AdcScanner::waitForReading(uint8_t pin, Reading &reading, uint32_t timeout_ms)
+{
+    unsigned long startTime = millis();
+    while (!getReading(pin, reading))
+    {
+        if (millis() - startTime > timeout_ms)
+        {
+            ESP_LOGE(TAG, "No data on pin %u", pin);
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+void AdcScanner::task(void *arg)
+{
+    AdcScanner *scanner = static_cast<AdcScanner *>(arg);
+    uint8_t frame[FRAME_SIZE];
+    for (;;)
+    {
+        uint32_t length = 0;
+        esp_err_t err = adc_digi_read_bytes(frame, FRAME_SIZE, &length, ADC_MAX_DELAY);
+        // ESP_ERR_INVALID_STATE : the driver's buffer overflowed, but the data is valid.
+        if (err == ESP_OK || err == ESP_ERR_INVALID_STATE)
+        {
+            scanner->processFrame(frame, length);
+        }
+    }
+}
+
+/**
+ * @brief Runs in the scanner task : accumulate the conversions and publish the readings.
+ */
+void AdcScanner::processFrame(const uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES)
+    {
+        const adc_digi_output_data_t *conversion = reinterpret_cast<const adc_digi_output_data_t *>(&data[i]);
+        if (conversion->type2.unit != ADC_NUM_1)
+        {
+            continue;
+        }
+        for (size_t j = 0; j < _channelCount; j++)
+        {
+            Channel &channel = _channels[j];
+            if (channel.adcChannel != conversion->type2.channel)
+            {
+                continue;
+            }
+            uint16_t raw = conversion->type2.data;
+            if (raw <= channel.maxValidRaw)
+            {
+                channel.reading.raw = raw;
+                channel.sum += raw;
+                channel.validCount++;
+            }
+            if (++channel.sampleCount == channel.samplesPerPeriod)
+            {
+                // When all conversions of the period were out of range, the previous mean stays published.
+                if (channel.validCount > 0)
+                {
+                    channel.reading.filteredRaw = (channel.sum + channel.validCount / 2) / channel.validCount;
+                    channel.reading.filtered_mV = esp_adc_cal_raw_to_voltage(channel.reading.filteredRaw, &adcCharacteristics);
+                    channel.reading.count++;
+                }
+                channel.sum = 0;
+                channel.sampleCount = 0;
+                channel.validCount = 0;
+            }
+            break;
+        }
+    }
+    for (size_t j = 0; j < _channelCount; j++)
+    {
+        Channel &channel = _channels[j];
+        if (channel.reading.count > 0)
+        {
+            channel.reading.mV = esp_adc_cal_raw_to_voltage(channel.reading.raw, &adcCharacteristics);
+            channel.slot.write(channel.reading);
+        }
+    }
+}
+
+/**
+ * @brief Highest conversion result below a voltage, so that the scan can compare the raw values
+ * @details The calibration curve is monotonic : binary search.  A full scale conversion is saturated, the input voltage is unknown,
+ * so it's always rejected, also when the limit is beyond the calibrated range.
+ */
+uint16_t AdcScanner::maxRaw(uint16_t maxValid_mV)
+{
+    uint32_t low = 0;
+    uint32_t high = (1 << SOC_ADC_DIGI_MAX_BITWIDTH) - 2;
+    if (esp_adc_cal_raw_to_voltage(high, &adcCharacteristics) < maxValid_mV)
+    {
+        ESP_LOGW(TAG, "%u mV is beyond the calibrated range, only saturated conversions are rejected", maxValid_mV);
+        return high;
+    }
+    while (low < high)
+    {
+        uint32_t middle = (low + high + 1) / 2;
+        if (esp_adc_cal_raw_to_voltage(middle, &adcCharacteristics) < maxValid_mV)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    ESP_LOGI(TAG, "Conversions above %u (%u mV) are rejected", low, maxValid_mV);
+    return low;
+}
+
+AdcScanner::Channel *AdcScanner::findChannel(uint8_t pin)
+{
+    for (size_t i = 0; i < _channelCount; i++)
+    {
+        if (_channels[i].pin == pin)
+        {
+            return &_channels[i];
+        }
+    }
+    return nullptr;
+}
@@ -1,53 +1,231 @@
 #include "buttons.h"
-#include <Arduino.h>
+#include "eventBus.h"
+#include "profiler.h"
+#include <driver/gpio.h>
+#include <esp_sleep.h>
 
 static const char *TAG = "Buttons";
 
-ButtonReader::ButtonReader(const int adcPin) : _adcPin(adcPin),
-                                               _lastButtonState(ButtonSelection::None),
-                                               _bouncingButtonState(ButtonSelection::None)
+ButtonReader::ButtonReader(AdcScanner &adc, EventBus &bus, const int adcPin) : _adc(adc),
+                                                                                _bus(bus),
+                                                                                _adcPin(adcPin),
+                                                                                _lastButtonState(ButtonSelection::None),
+                                                                                _bouncingButtonState(ButtonSelection::None)
 {
 }
 
 ButtonReader::~ButtonReader()
 {
+    if (_timer != nullptr)
+    {
+        esp_timer_stop(_timer);
+        esp_timer_delete(_timer);
+    }
+    if (_wakeTimer != nullptr)
+    {
+        esp_timer_stop(_wakeTimer);
+        esp_timer_delete(_wakeTimer);
+    }
+}
+
+/**
+ * @brief Start sampling the buttons in the background
+ *
+ * @return true when successful
+ */
+bool ButtonReader::begin()
+{
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = &ButtonReader::onTimer;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "buttons";
+    if (esp_timer_create(&timerArgs, &_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't create button timer");
+        return false;
+    }
+    // Both timers run in the esp_timer task, so the sleep state needs no lock.
+    timerArgs.callback = &ButtonReader::onWakeTimer;
+    timerArgs.name = "buttonWake";
+    if (esp_timer_create(&timerArgs, &_wakeTimer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't create button wake-up timer");
+        return false;
+    }
+
+    // The digital input buffer doesn't disturb the ADC.  The interrupt is only enabled while sleeping.
+    gpio_num_t pin = static_cast<gpio_num_t>(_adcPin);
+    gpio_set_direction(pin, GPIO_MODE_INPUT);
+    gpio_set_intr_type(pin, GPIO_INTR_LOW_LEVEL);
+    esp_err_t err = gpio_install_isr_service(0);
+    if ((err != ESP_OK && err != ESP_ERR_INVALID_STATE) || gpio_isr_handler_add(pin, &ButtonReader::onButtonInterrupt, this) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't install the button interrupt");
+        return false;
+    }
+    gpio_intr_disable(pin);
+    gpio_wakeup_enable(pin, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+    return esp_timer_start_periodic(_timer, SAMPLE_PERIOD_us) == ESP_OK;
 }
 
 /**
- * @brief Update the button state.
- * 
- * @return true if the button state has changed.
+ * @brief Allow the sampling to stop while no button is used.  Disallowed while the motor runs or WiFi is on : they need the ADC
+ * scan.
+ * @details Can be called from any task, also before begin().  When disallowed, the sampling restarts right away.
  */
-bool ButtonReader::update()
+void ButtonReader::setSleepAllowed(bool allowed)
 {
+    _sleepAllowed = allowed;
+    if (!allowed && _wakeTimer != nullptr)
+    {
+        _wakeRequested = true;
+        esp_timer_stop(_wakeTimer);
+        esp_timer_start_once(_wakeTimer, 0);
+    }
+}
+
+void ButtonReader::onTimer(void *arg)
+{
+    ButtonReader *reader = static_cast<ButtonReader *>(arg);
+    reader->sample();
+    if (reader->_lastButtonState != ButtonSelection::None || reader->_bouncingButtonState != ButtonSelection::None ||
+        !reader->_sleepAllowed)
+    {
+        reader->_idleSamples = 0;
+    }
+    else if (++reader->_idleSamples >= IDLE_SAMPLES)
+    {
+        reader->sleep();
+    }
+}
+
+void ButtonReader::onWakeTimer(void *arg)
+{
+    static_cast<ButtonReader *>(arg)->wakeUp();
+}
+
+/**
+ * @brief The level interrupt would fire as long as the button is held : it's disabled until the next sleep.
+ */
+void IRAM_ATTR ButtonReader::onButtonInterrupt(void *arg)
+{
+    ButtonReader *reader = static_cast<ButtonReader *>(arg);
+    gpio_intr_disable(static_cast<gpio_num_t>(reader->_adcPin));
+    reader->_wakeRequested = true;
+    esp_timer_stop(reader->_wakeTimer);
+    esp_timer_start_once(reader->_wakeTimer, 0);
+}
+
+/**
+ * @brief Runs in the esp_timer task : stop sampling and the ADC scan, until the button interrupt or the next probe.
+ */
+void ButtonReader::sleep()
+{
+    esp_timer_stop(_timer);
+    _adc.pause();
+    _sleeping = true;
+    // Armed before the interrupt is enabled, so that an interrupt right away restarts it.
+    esp_timer_stop(_wakeTimer);
+    esp_timer_start_once(_wakeTimer, POLL_PERIOD_us);
+    gpio_intr_enable(static_cast<gpio_num_t>(_adcPin));
+}
+
+/**
+ * @brief Runs in the esp_timer task : restart the ADC scan and the sampling.
+ * @details After a probe, the sampling stops again after PROBE_SAMPLES unless a button is seen.  After the interrupt or when
+ * sleep is no longer allowed, it runs for at least IDLE_SAMPLES.
+ */
+void ButtonReader::wakeUp()
+{
+    bool requested = _wakeRequested;
+    _wakeRequested = false;
+    if (!_sleeping)
+    {
+        if (requested)
+        {
+            _idleSamples = 0;
+        }
+        return;
+    }
+    gpio_intr_disable(static_cast<gpio_num_t>(_adcPin));
+    _sleeping = false;
+    _adc.resume();
+    _idleSamples = requested ? 0 : IDLE_SAMPLES - PROBE_SAMPLES;
+    esp_timer_start_periodic(_timer, SAMPLE_PERIOD_us);
+}
+
+/**
+ * @brief Runs in the esp_timer task : debounce the button state and generate the events.
+ */
+void ButtonReader::sample()
+{
+    PROFILE_SECTION(ButtonSample);
     ButtonSelection buttonState = getPushedButton();
     if (buttonState != _bouncingButtonState)
     {
-        //State is not stable
-       _debounceDelay.start(50, AsyncDelay::MILLIS);
+        // State is not stable
+        _bouncingButtonState = buttonState;
+        _bouncingSamples = 0;
+        return;
     }
-    _bouncingButtonState = buttonState;
-    if (_debounceDelay.isExpired())
+    if (_bouncingSamples < DEBOUNCE_SAMPLES)
     {
-        //State is stable
-        if(_bouncingButtonState != _lastButtonState)
+        _bouncingSamples++;
+        return;
+    }
+    // State is stable
+    _stable = true;
+    if (_bouncingButtonState != _lastButtonState)
+    {
+        if (_lastButtonState != ButtonSelection::None)
         {
-            _lastButtonState = _bouncingButtonState;
-            return true;
+            pushEvent(EventType::Released, _lastButtonState);
+        }
+        _lastButtonState = _bouncingButtonState;
+        _pressedSamples = 0;
+        if (_lastButtonState != ButtonSelection::None)
+        {
+            pushEvent(EventType::Pressed, _lastButtonState);
+        }
+        return;
+    }
+    // State is stable and has not changed
+    if (_lastButtonState != ButtonSelection::None && _pressedSamples < LONG_PRESS_SAMPLES)
+    {
+        if (++_pressedSamples == LONG_PRESS_SAMPLES)
+        {
+            pushEvent(EventType::LongPress, _lastButtonState);
         }
-        //State is stable and has not changed
     }
-    return false;
+}
+
+void ButtonReader::pushEvent(EventType type, ButtonSelection button)
+{
+    EventBus::Event event = {EventBus::EventType::ButtonEvent};
+    event.button = {type, button};
+    _bus.post(event);
 }
 
 ButtonReader::ButtonSelection ButtonReader::getPushedButton()
 {
-    uint32_t adcValue = analogReadMilliVolts(_adcPin);
+    // Median of the last readings, so that a single disturbed reading doesn't cause a button state change.
+    // The scanner averages over ADC_PERIOD, so the reading during a button transition is an intermediate value.
+    AdcScanner::Reading reading;
+    if (_adc.getReading(_adcPin, reading))
+    {
+        _adcValue.add(reading.filtered_mV);
+    }
+    if (_adcValue.count() == 0)
+    {
+        return ButtonSelection::None;
+    }
+    uint32_t adcValue = _adcValue.get();
     const uint32_t MAX_BUTTON_DOWN_ADC_VALUE = 1100;
     const uint32_t MAX_BUTTON_STANDBY_ADC_VALUE = 2000;
     const uint32_t MAX_BUTTON_UP_ADC_VALUE = 2600;
     //ESP_LOGD(TAG, "ADC value: %d", adcValue);
-    delay(100);
     if (adcValue < MAX_BUTTON_DOWN_ADC_VALUE)
     {
         // ADC value is 604mV when button is pressed
@@ -68,4 +246,4 @@ ButtonReader::ButtonSelection ButtonReader::getPushedButton()
         // ADC value is 2800mV when no button is pressed
         return ButtonSelection::None;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,133 @@
+#include "console.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const char *TAG = "Console";
+
+static const UBaseType_t TASK_PRIORITY = 1;                                 //!< Below all other tasks
+
+static StaticTask_t taskBuffer;
+static StackType_t taskStack[Console::TASK_STACK_SIZE];
+
+Console::Console(Stream &stream, const Command *commands, size_t commandCount) : _stream(stream),
+                                                                              _commands(commands),
+                                                                              _commandCount(commandCount)
+{
+}
+
+Console::~Console()
+{
+}
+
+/**
+ * @brief Start the console task
+ *
+ * @return true when successful
+ */
+bool Console::begin()
+{
+    if (xTaskCreateStatic(&Console::task, "console", TASK_STACK_SIZE, this, TASK_PRIORITY, taskStack, &taskBuffer) == nullptr)
+    {
+        ESP_LOGE(TAG, "Can't create console task");
+        return false;
+    }
+    return true;
+}
+
+void Console::task(void *arg)
+{
+    Console *console = static_cast<Console *>(arg);
+    for (;;)
+    {
+        console->poll();
+        vTaskDelay(pdMS_TO_TICKS(POLL_PERIOD));
+    }
+}
+
+/**
+ * @brief Read the available characters and execute each complete line.  Lines that are too long are discarded.
+ */
+void Console::poll()
+{
+    while (_stream.available() > 0)
+    {
+        int c = _stream.read();
+        if (c < 0)
+        {
+            break;
+        }
+        if (c == '\r' || c == '\n')
+        {
+            if (_overflow)
+            {
+                _stream.println("Line too long");
+            }
+            else if (_length > 0)
+            {
+                _line[_length] = '\0';
+                execute(_line);
+            }
+            _length = 0;
+            _overflow = false;
+        }
+        else if (_length < MAX_LINE_LENGTH)
+        {
+            _line[_length++] = c;
+        }
+        else
+        {
+            _overflow = true;
+        }
+    }
+}
+
+void Console::execute(char *line)
+{
+    while (*line == ' ')
+    {
+        line++;
+    }
+    char *args = line;
+    while (*args != '\0' && *args != ' ')
+    {
+        args++;
+    }
+    if (*args != '\0')
+    {
+        *args++ = '\0';
+        while (*args == ' ')
+        {
+            args++;
+        }
+    }
+    if (*line == '\0')
+    {
+        return;
+    }
+    for (size_t i = 0; i < _commandCount; i++)
+    {
+        if (strcmp(line, _commands[i].name) == 0)
+        {
+            _commands[i].handler(_stream, args);
+            return;
+        }
+    }
+    if (strcmp(line, "help") != 0)
+    {
+        // Not printf() : it allocates on the heap for more than 63 characters
+        _stream.print("Unknown command: ");
+        _stream.print(line);
+        _stream.print("\r\n");
+    }
+    printHelp();
+}
+
+void Console::printHelp()
+{
+    for (size_t i = 0; i < _commandCount; i++)
+    {
+        _stream.printf("%-8s ", _commands[i].name);
+        _stream.print(_commands[i].help);
+        _stream.print("\r\n");
+    }
+}
@@ -0,0 +1,84 @@
+#include "eventBus.h"
+#include "profiler.h"
+
+static const char *TAG = "EventBus";
+
+EventBus::EventBus()
+{
+}
+
+EventBus::~EventBus()
+{
+}
+
+/**
+ * @brief Create the event queue.  Must be called before any event is posted.
+ *
+ * @return true when successful
+ */
+bool EventBus::begin()
+{
+    _queue = xQueueCreateStatic(QUEUE_LENGTH, sizeof(Event), _queueStorage, &_queueBuffer);
+    return _queue != nullptr;
+}
+
+/**
+ * @brief Register a handler for an event type.  Only to be called at init.
+ *
+ * @return true when successful, false when the subscriber table is full
+ */
+bool EventBus::subscribe(EventType type, Handler handler)
+{
+    if (_subscriptionCount >= MAX_SUBSCRIBERS || handler == nullptr)
+    {
+        ESP_LOGE(TAG, "Can't subscribe to event %d", static_cast<int>(type));
+        return false;
+    }
+    _subscriptions[_subscriptionCount++] = {type, handler};
+    return true;
+}
+
+/**
+ * @brief Post an event, can be called from any task.
+ * @details Never blocks, except for the configuration of a web client : its events are lost for good when dropped, so they wait
+ * up to CONFIG_POST_TIMEOUT for room in the queue.  The other events are produced again, e.g. the next button sample.
+ * @return true when successful, false when the queue is full and the event has been dropped
+ */
+bool EventBus::post(const Event &event)
+{
+    TickType_t timeout = 0;
+    if (event.type == EventType::ConfigReceived || event.type == EventType::TimeReceived)
+    {
+        timeout = CONFIG_POST_TIMEOUT;
+    }
+    if (_queue == nullptr || xQueueSend(_queue, &event, timeout) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Event %d dropped", static_cast<int>(event.type));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Wait for the next event and call its handlers
+ *
+ * @param timeout maximum time to wait for an event
+ * @return true when an event has been dispatched, false on timeout
+ */
+bool EventBus::dispatch(TickType_t timeout)
+{
+    Event event;
+    if (xQueueReceive(_queue, &event, timeout) != pdTRUE)
+    {
+        return false;
+    }
+    PROFILE_SECTION(EventHandlers);
+    for (size_t i = 0; i < _subscriptionCount; i++)
+    {
+        if (_subscriptions[i].type == event.type)
+        {
+            _subscriptions[i].handler(event);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,221 @@
+#include "eventLog.h"
+#include <esp_rom_crc.h>
+
+static const char *TAG = "EventLog";
+
+static const char *PARTITION_LABEL = "eventlog";
+static const uint32_t SECTOR_MAGIC = 0x474C4445; // "EDLG"
+
+EventLog::EventLog()
+{
+}
+
+EventLog::~EventLog()
+{
+}
+
+/**
+ * @brief Find the active sector and its first free record.  Formats the partition when it doesn't hold a log yet.
+ *
+ * @return true when successful
+ */
+bool EventLog::begin()
+{
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION_LABEL);
+    if (_partition == nullptr || _partition->size / SECTOR_SIZE < 2)
+    {
+        ESP_LOGE(TAG, "No %s partition", PARTITION_LABEL);
+        return false;
+    }
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+    if (_mutex == nullptr)
+    {
+        return false;
+    }
+    _sectorCount = _partition->size / SECTOR_SIZE;
+    bool found = false;
+    for (size_t sector = 0; sector < _sectorCount; sector++)
+    {
+        SectorHeader header;
+        // Sequence numbers are compared with wrap around
+        if (readHeader(sector, header) && (!found || static_cast<int32_t>(header.sequence - _sequence) > 0))
+        {
+            _sector = sector;
+            _sequence = header.sequence;
+            found = true;
+        }
+    }
+    if (!found)
+    {
+        ESP_LOGI(TAG, "Formatting the event log");
+        _count = 0;
+        return startSector(0, 1);
+    }
+    _slot = findFreeSlot(_sector);
+    // The full sectors before the active one
+    size_t fullSectors = 0;
+    for (size_t back = 1; back < _sectorCount; back++)
+    {
+        SectorHeader header;
+        if (!readHeader((_sector + _sectorCount - back) % _sectorCount, header) || header.sequence != _sequence - back)
+        {
+            break;
+        }
+        fullSectors++;
+    }
+    _count = _slot + fullSectors * RECORDS_PER_SECTOR;
+    ESP_LOGI(TAG, "%u records, active sector %u", (unsigned)_count, (unsigned)_sector);
+    return true;
+}
+
+/**
+ * @brief Append a record.  Erases the oldest sector when the active sector is full.
+ *
+ * @return true when successful
+ */
+bool EventLog::append(Source source, bool opening, uint8_t stopReason, uint16_t peakCurrent, uint16_t battery_mV,
+                      uint32_t travelTime_ms)
+{
+    if (_partition == nullptr)
+    {
+        return false;
+    }
+    Record record;
+    record.utc = time(nullptr);
+    record.flags = (static_cast<uint8_t>(source) & 0x03) | (opening ? 0x04 : 0) | ((stopReason & 0x07) << 3);
+    record.peakCurrent = peakCurrent;
+    record.battery_mV = battery_mV;
+    record.travelTime_ds = min(travelTime_ms / 100, (uint32_t)UINT16_MAX);
+    record.crc = crc(record);
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    bool success = true;
+    if (_slot >= RECORDS_PER_SECTOR)
+    {
+        // The oldest sector is overwritten once all sectors are in use
+        _count = min(_count, (_sectorCount - 1) * RECORDS_PER_SECTOR);
+        success = startSector((_sector + 1) % _sectorCount, _sequence + 1);
+    }
+    if (success)
+    {
+        success = esp_partition_write(_partition, recordOffset(_sector, _slot), &record, sizeof(record)) == ESP_OK;
+        // A failed write may have changed the slot, so it's never reused
+        _slot++;
+        _count++;
+    }
+    xSemaphoreGive(_mutex);
+    if (!success)
+    {
+        ESP_LOGE(TAG, "Can't append a record");
+    }
+    return success;
+}
+
+/**
+ * @brief Read records, newest first.  Records with a CRC error are skipped.
+ *
+ * @param first index of the first record to read, 0 is the newest record
+ * @param records
+ * @param count maximum number of records to read
+ * @return size_t number of records read
+ */
+size_t EventLog::read(size_t first, Record *records, size_t count)
+{
+    if (_partition == nullptr)
+    {
+        return 0;
+    }
+    size_t read = 0;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (size_t index = first; index < _count && index < first + count; index++)
+    {
+        size_t sector;
+        size_t slot;
+        if (index < _slot)
+        {
+            sector = _sector;
+            slot = _slot - 1 - index;
+        }
+        else
+        {
+            // Previous sectors are full
+            size_t back = 1 + (index - _slot) / RECORDS_PER_SECTOR;
+            sector = (_sector + _sectorCount - back) % _sectorCount;
+            slot = RECORDS_PER_SECTOR - 1 - (index - _slot) % RECORDS_PER_SECTOR;
+        }
+        Record &record = records[read];
+        if (esp_partition_read(_partition, recordOffset(sector, slot), &record, sizeof(record)) == ESP_OK && !isErased(record) &&
+            record.crc == crc(record))
+        {
+            read++;
+        }
+    }
+    xSemaphoreGive(_mutex);
+    return read;
+}
+
+bool EventLog::readHeader(size_t sector, SectorHeader &header)
+{
+    return esp_partition_read(_partition, sector * SECTOR_SIZE, &header, sizeof(header)) == ESP_OK && header.magic == SECTOR_MAGIC;
+}
+
+/**
+ * @brief Erase a sector and make it the active sector
+ */
+bool EventLog::startSector(size_t sector, uint32_t sequence)
+{
+    SectorHeader header = {SECTOR_MAGIC, sequence};
+    if (esp_partition_erase_range(_partition, sector * SECTOR_SIZE, SECTOR_SIZE) != ESP_OK ||
+        esp_partition_write(_partition, sector * SECTOR_SIZE, &header, sizeof(header)) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't start sector %u", (unsigned)sector);
+        return false;
+    }
+    _sector = sector;
+    _sequence = sequence;
+    _slot = 0;
+    return true;
+}
+
+/**
+ * @brief Binary search for the first erased record : records are written in order, so all records after it are erased too.
+ */
+size_t EventLog::findFreeSlot(size_t sector)
+{
+    size_t low = 0;
+    size_t high = RECORDS_PER_SECTOR;
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        Record record;
+        if (esp_partition_read(_partition, recordOffset(sector, middle), &record, sizeof(record)) == ESP_OK && isErased(record))
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+bool EventLog::isErased(const Record &record) const
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&record);
+    for (size_t i = 0; i < sizeof(record); i++)
+    {
+        if (bytes[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint8_t EventLog::crc(const Record &record)
+{
+    Record copy = record;
+    copy.crc = 0;
+    return esp_rom_crc8_le(0, reinterpret_cast<const uint8_t *>(&copy), sizeof(copy));
+}
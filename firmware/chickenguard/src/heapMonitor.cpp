@@ -0,0 +1,83 @@
+#include "heapMonitor.h"
+#include <esp_heap_caps.h>
+
+static const char *TAG = "HeapMonitor";
+
+HeapMonitor::HeapMonitor()
+{
+}
+
+HeapMonitor::~HeapMonitor()
+{
+}
+
+/**
+ * @brief Add a task of which the stack high water mark will be sampled
+ *
+ * @return true when successful
+ */
+bool HeapMonitor::addTask(TaskHandle_t task)
+{
+    if (task == nullptr || _taskCount >= MAX_TASKS)
+    {
+        return false;
+    }
+    _tasks[_taskCount++] = task;
+    return true;
+}
+
+/**
+ * @brief Add a sample to the history, overwriting the oldest one
+ *
+ * @return the new sample
+ */
+const HeapMonitor::Sample &HeapMonitor::sample()
+{
+    Sample &sample = _history[_sampleCount % HISTORY_LENGTH];
+    sample.time_s = millis() / 1000;
+    sample.freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    sample.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    sample.minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    for (size_t i = 0; i < MAX_TASKS; i++)
+    {
+        sample.stackHighWaterMark[i] = i < _taskCount ? uxTaskGetStackHighWaterMark(_tasks[i]) : 0;
+    }
+    _sampleCount++;
+    if (isLow())
+    {
+        ESP_LOGW(TAG, "Heap low: free %lu, largest block %lu", sample.freeHeap, sample.largestBlock);
+    }
+    return sample;
+}
+
+/**
+ * @brief Check the latest sample against the warning thresholds
+ */
+bool HeapMonitor::isLow() const
+{
+    if (_sampleCount == 0)
+    {
+        return false;
+    }
+    const Sample &sample = _history[(_sampleCount - 1) % HISTORY_LENGTH];
+    return sample.freeHeap < LOW_FREE_HEAP || sample.largestBlock < LOW_LARGEST_BLOCK;
+}
+
+/**
+ * @brief Print the history, oldest sample first
+ */
+void HeapMonitor::dump(Print &output) const
+{
+    size_t first = _sampleCount > HISTORY_LENGTH ? _sampleCount - HISTORY_LENGTH : 0;
+    output.println("  time[s]     free  largest  minimum  stacks");
+    for (size_t i = first; i < _sampleCount; i++)
+    {
+        const Sample &sample = _history[i % HISTORY_LENGTH];
+        output.printf("%9lu %8lu %8lu %8lu ", sample.time_s, sample.freeHeap, sample.largestBlock, sample.minFreeHeap);
+        for (size_t j = 0; j < _taskCount; j++)
+        {
+            output.printf(" %s:%u", pcTaskGetName(_tasks[j]), sample.stackHighWaterMark[j]);
+        }
+        output.println();
+    }
+}
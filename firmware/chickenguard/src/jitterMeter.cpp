@@ -0,0 +1,35 @@
+#include "jitterMeter.h"
+
+static const char *TAG = "JitterMeter";
+
+JitterMeter::JitterMeter(const char *name, uint32_t period_us) : _name(name),
+                                                                 _period_us(period_us)
+{
+}
+
+void JitterMeter::record(int64_t now_us)
+{
+    if (_lastActivation != 0)
+    {
+        uint32_t interval = now_us - _lastActivation;
+        _minInterval = min(_minInterval, interval);
+        _maxInterval = max(_maxInterval, interval);
+        _sumInterval += interval;
+        _count++;
+    }
+    _lastActivation = now_us;
+}
+
+void JitterMeter::log()
+{
+    if (_count == 0)
+    {
+        return;
+    }
+    ESP_LOGD(TAG, "%s: period %lu us, interval min/avg/max %lu/%lu/%lu us over %lu activations", _name, _period_us, _minInterval,
+             (uint32_t)(_sumInterval / _count), _maxInterval, _count);
+    _count = 0;
+    _minInterval = UINT32_MAX;
+    _maxInterval = 0;
+    _sumInterval = 0;
+}
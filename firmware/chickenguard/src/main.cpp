@@ -2,6 +2,7 @@
  */
 
 #include "pins.h"
+#include "adcScanner.h"
 #include "Webservice.h"
 #include <AsyncDelay.h>
 #include "timeControl.h"
@@ -11,6 +12,17 @@
 #include "motorControl.h"
 #include "buttons.h"
 #include "display.h"
+#include "telemetry.h"
+#include "jitterMeter.h"
+#include "eventBus.h"
+#include "powerPolicy.h"
+#include "profiler.h"
+#include "console.h"
+#include "heapMonitor.h"
+#include "eventLog.h"
+#include "traceLog.h"
+#include <esp_heap_caps.h>
+#include <nvs.h>
 #include "wifi_credentials.h"
 
 static const char *TAG = "Main";
@@ -19,25 +31,153 @@ static const char *TAG = "Main";
 #warning "USB mode enabled"
 #endif
 
+/**
+ * Task layout, the tasks only communicate through queues :
+ *  - motor task (high priority) : runs the motor state machine every MOTOR_PERIOD ms and samples the telemetry
+ *  - scheduler task (medium priority) : dispatches the events of the event bus and polls the RTC alarms.  Owns the RTC and the display.
+ *  - network task (low priority) : DNS, websocket and webserver
+ *  - console task (lowest priority) : diagnostic commands on the serial port
+ * Each task logs its stack high water mark every STATISTICS_PERIOD ms, the motor task also logs its activation jitter.  The console
+ * "stats" command shows the stack used by each task since boot.
+ * The stack sizes below are estimates : they haven't been measured on the board yet.  To size them, read "stats" after a motor
+ * run with the webserver active and a web configuration, then set each size to the largest use seen plus 25%, rounded up to 256
+ * bytes.
+ */
+struct MotorCommand
+{
+    enum class Action
+    {
+        Open,
+        Close
+    } action;
+    EventLog::Source source; //!< Recorded in the event log at the end of the run
+};
+struct NetworkMessage
+{
+    enum class Type
+    {
+        StartWebserver,
+        Telemetry
+    } type;
+    uint8_t length;
+    uint8_t frame[Telemetry::MAX_FRAME_SIZE];
+};
+
+static void motorTask(void *arg);
+static void schedulerTask(void *arg);
+static void networkTask(void *arg);
 static void displayWifiCredentials();
-static void webConfigDone();
-static void updateTime(long utc, const String timezone);
+static bool webConfigReceived(const WsProtocol::Config &webConfig);
 static void setOpenDoorAlarm(NonVolatileStorage::DoorControl const doorControl);
 static void setCloseDoorAlarm(NonVolatileStorage::DoorControl const doorControl);
-static void handleButtonPress(ButtonReader::ButtonSelection buttonState);
+static void handleAlarm(const EventBus::Event &event);
+static void handleButtonEvent(const EventBus::Event &event);
+static void handleMotorStopped(const EventBus::Event &event);
+static void handleConfigReceived(const EventBus::Event &event);
+static void handleTimeReceived(const EventBus::Event &event);
+static void handleBatteryLow(const EventBus::Event &event);
+static void handlePowerTimeout(const EventBus::Event &event);
+static void pollAlarms();
+static void reconcileSchedule();
+static bool getScheduleToday(time_t &openTime, time_t &closeTime);
+static bool moveDoor(const MotorCommand &command, bool force);
+static void startWebserver();
 static void powerOff();
+static void idleChanged(bool idle);
+static const char *getTimeZone();
+static void sendTelemetry(bool motorStarted);
+static void queueTelemetryFrame();
+static void logStackHighWaterMark();
+static unsigned long timeUntil(const AsyncDelay &delay);
+static void publishStatusSnapshot();
+static time_t nextAlarmTime(time_t alarmTime, time_t now);
+static void formatLocalTime(time_t utc, char *buffer, size_t size);
+static void printStatus(Print &output);
+static void printAlarmTime(Print &output, const char *name, time_t utc, const char *local);
+static void consoleStats(Print &output, const char *args);
+static void consoleI2c(Print &output, const char *args);
+static void consoleTrace(Print &output, const char *args);
+static void consoleNvs(Print &output, const char *args);
+static void consoleMotor(Print &output, const char *args);
+static void consoleRtc(Print &output, const char *args);
+static void consoleHeap(Print &output, const char *args);
 
+static const uint32_t MOTOR_PERIOD = 10;          //!< [ms]
+static const unsigned long RTC_POLLING_PERIOD = 1000;
+static const uint32_t NETWORK_PERIOD = 10;        //!< [ms]
+static const unsigned long STATISTICS_PERIOD = 10000;
+static const unsigned long HEAP_SAMPLE_PERIOD = 1000;
+static const UBaseType_t MOTOR_TASK_PRIORITY = 5;
+static const UBaseType_t SCHEDULER_TASK_PRIORITY = 3;
+static const UBaseType_t NETWORK_TASK_PRIORITY = 2;
+static const uint32_t MOTOR_TASK_STACK_SIZE = 4096;      //!< NVS writes at the end of a motor run
+static const uint32_t SCHEDULER_TASK_STACK_SIZE = 4096;  //!< NVS writes and sunrise calculation
+static const uint32_t NETWORK_TASK_STACK_SIZE = 6144;    //!< WiFi initialization, JSON
+static const size_t MOTOR_QUEUE_LENGTH = 4;
+static const size_t NETWORK_QUEUE_LENGTH = 4;
+
+static EventBus bus;
+static PowerPolicy powerPolicy;
 static TimeControl timeControl(readBytes, writeBytes);
 static NonVolatileStorage config;
-static Webservice webserver(&config, updateTime, webConfigDone);
+static EventLog eventLog;
+static Webservice webserver(&eventLog, webConfigReceived, printStatus);
+static AdcScanner adc;
 // Voltage divider scale = (R306+R309)/R309
-static powerControl power(powerControl::BatteryTech::Alkaline, 4, 4.03);
-static MotorControl motor(MOTOR_IN1, MOTOR_IN2, MOTOR_CURRENT_SENSE);
+static powerControl power(adc, bus, powerControl::BatteryTech::Alkaline, 4, 4.03);
+static MotorControl motor(MOTOR_IN1, MOTOR_IN2, adc, MOTOR_CURRENT_SENSE);
 static AsyncDelay rtcPollingDelay;
-static ButtonReader button(SNS_BUTTON);
+static ButtonReader button(adc, bus, SNS_BUTTON);
 static Display display;
-static bool motorRunning = false;
-static AsyncDelay batteryStatusDelay;
+static Telemetry telemetry;
+static HeapMonitor heapMonitor;
+static AsyncDelay telemetryDelay;
+static const Console::Command consoleCommands[] = {
+    {"stats", "uptime, battery, motor state, stack high water marks and profiler", consoleStats},
+    {"i2c", "scan the I2C bus", consoleI2c},
+    {"trace", "dump : show the trace log", consoleTrace},
+    {"nvs", "dump : show all keys in NVS", consoleNvs},
+    {"motor", "open | close : run the motor", consoleMotor},
+    {"rtc", "show the RTC and MCU time", consoleRtc},
+    {"heap", "show the heap usage and its history", consoleHeap},
+};
+static Console console(Serial, consoleCommands, sizeof(consoleCommands) / sizeof(consoleCommands[0]));
+
+static QueueHandle_t motorQueue;
+static StaticQueue_t motorQueueBuffer;
+static uint8_t motorQueueStorage[MOTOR_QUEUE_LENGTH * sizeof(MotorCommand)];
+static QueueHandle_t networkQueue;
+static StaticQueue_t networkQueueBuffer;
+static uint8_t networkQueueStorage[NETWORK_QUEUE_LENGTH * sizeof(NetworkMessage)];
+static StaticTask_t motorTaskBuffer;
+static StackType_t motorTaskStack[MOTOR_TASK_STACK_SIZE];
+static StaticTask_t schedulerTaskBuffer;
+static StackType_t schedulerTaskStack[SCHEDULER_TASK_STACK_SIZE];
+static StaticTask_t networkTaskBuffer;
+static StackType_t networkTaskStack[NETWORK_TASK_STACK_SIZE];
+static TaskHandle_t motorTaskHandle;
+static TaskHandle_t schedulerTaskHandle;
+static TaskHandle_t networkTaskHandle;
+
+/**
+ * @brief The unit status of GET /status.  The scheduler task publishes it, the HTTP handler runs in the async_tcp task and only
+ * formats a copy : it doesn't access the RTC or NVS.
+ */
+struct StatusSnapshot
+{
+    bool valid; //!< Published at least once
+    NonVolatileStorage::DoorState door;
+    uint8_t mode; //!< NonVolatileStorage::DoorControl
+    bool scheduled; //!< The next alarms are known
+    time_t nextOpen;
+    time_t nextClose;
+    char nextOpenLocal[32];
+    char nextCloseLocal[32];
+};
+static StatusSnapshot statusSnapshot = {};
+static SemaphoreHandle_t statusMutex;
+static StaticSemaphore_t statusMutexBuffer;
+static bool statusChanged = true; //!< Only used by the scheduler task
 
 void setup()
 {
@@ -51,86 +191,524 @@ void setup()
         ;
     ESP_LOGD(TAG, "\r\nBuild %s, utc: %lu\r\n", COMMIT_HASH, CURRENT_TIME);
 
+#ifdef ENABLE_PROFILER
+    Profiler::calibrate();
+#endif
+    powerPolicy.setIdleHandler(idleChanged);
+    assert(powerPolicy.begin());
+    motorQueue = xQueueCreateStatic(MOTOR_QUEUE_LENGTH, sizeof(MotorCommand), motorQueueStorage, &motorQueueBuffer);
+    assert(bus.begin());
+    bus.subscribe(EventBus::EventType::AlarmFired, handleAlarm);
+    bus.subscribe(EventBus::EventType::ButtonEvent, handleButtonEvent);
+    bus.subscribe(EventBus::EventType::MotorStopped, handleMotorStopped);
+    bus.subscribe(EventBus::EventType::ConfigReceived, handleConfigReceived);
+    bus.subscribe(EventBus::EventType::TimeReceived, handleTimeReceived);
+    bus.subscribe(EventBus::EventType::BatteryLow, handleBatteryLow);
+    bus.subscribe(EventBus::EventType::PowerTimeout, handlePowerTimeout);
+    networkQueue = xQueueCreateStatic(NETWORK_QUEUE_LENGTH, sizeof(NetworkMessage), networkQueueStorage, &networkQueueBuffer);
+    statusMutex = xSemaphoreCreateMutexStatic(&statusMutexBuffer);
+
+    // All analog inputs are sampled by a single ADC scan, each at its own rate
+    assert(adc.addChannel(SNS_BUTTON, ButtonReader::ADC_PERIOD));
+    assert(adc.addChannel(SNS_VMOTOR, powerControl::ADC_PERIOD, powerControl::MAX_mV_MEASUREMENT));
+    assert(adc.addChannel(MOTOR_CURRENT_SENSE, MotorControl::ADC_PERIOD));
+    assert(adc.begin());
+
     power.init();
     motor.init(power.getVoltage_mV());
-    config.restoreAll();
+    // The settings are only read when they're needed, the door state is needed at every wake-up
+    assert(config.begin());
+    config.restoreDoorState();
+    // Not fatal : the door can be controlled without the log
+    eventLog.begin();
     assert(i2c_hal_init(I2C_SDA, I2C_SCL));
 
-    // Check if woken up by button press
-    while (!button.isButtonStateStable())
-    {
-        delay(10);
-    }
-    ButtonReader::ButtonSelection buttonState = button.getButton();
-    if (buttonState != ButtonReader::ButtonSelection::None)
-    {
-
-        handleButtonPress(buttonState);
-    }
+    // When woken up by a button press, the press will be posted as a button event and handled by the scheduler task.
+    assert(button.begin());
 
     display.init(delayMicroseconds);
 
-    assert(timeControl.init(config.getTimeZone()));
+    // The time zone is only read when a local time is needed
+    assert(timeControl.init(getTimeZone));
     if (!timeControl.hasValidTime())
     {
         ESP_LOGE(TAG, "Time is not valid");
         // User will have to set the time using the webserver
-        displayWifiCredentials();
-        webserver.setup();
+        startWebserver();
     }
 
+    motorTaskHandle = xTaskCreateStatic(motorTask, "motor", MOTOR_TASK_STACK_SIZE, nullptr, MOTOR_TASK_PRIORITY, motorTaskStack,
+                                        &motorTaskBuffer);
+    schedulerTaskHandle = xTaskCreateStatic(schedulerTask, "scheduler", SCHEDULER_TASK_STACK_SIZE, nullptr, SCHEDULER_TASK_PRIORITY,
+                                            schedulerTaskStack, &schedulerTaskBuffer);
+    networkTaskHandle = xTaskCreateStatic(networkTask, "network", NETWORK_TASK_STACK_SIZE, nullptr, NETWORK_TASK_PRIORITY,
+                                          networkTaskStack, &networkTaskBuffer);
+    assert(heapMonitor.addTask(motorTaskHandle));
+    assert(heapMonitor.addTask(schedulerTaskHandle));
+    assert(heapMonitor.addTask(networkTaskHandle));
+    assert(console.begin());
     ESP_LOGD(TAG, "Ready to rumble");
-    batteryStatusDelay.start(1000, AsyncDelay::MILLIS);
 }
 
 void loop()
 {
-    webserver.loop();
-    if(batteryStatusDelay.isExpired())
+    // All work is done by the tasks
+    vTaskDelete(nullptr);
+}
+
+/**
+ * @brief Runs the motor state machine at a fixed rate while the motor is running.  Measures its own activation jitter.
+ */
+void motorTask(void *arg)
+{
+    JitterMeter jitter("motor", MOTOR_PERIOD * 1000);
+    AsyncDelay statisticsDelay(STATISTICS_PERIOD, AsyncDelay::MILLIS);
+    TickType_t lastWakeTime = xTaskGetTickCount();
+    bool motorRunning = false;
+    MotorCommand lastCommand = {MotorCommand::Action::Open, EventLog::Source::Alarm};
+    for (;;)
+    {
+        MotorCommand command;
+        if (motorRunning)
+        {
+            vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(MOTOR_PERIOD));
+            jitter.record(esp_timer_get_time());
+        }
+        else
+        {
+            // No periodic wake-ups while the motor is off, so the CPU can sleep until a command arrives.
+            xQueuePeek(motorQueue, &command, portMAX_DELAY);
+            lastWakeTime = xTaskGetTickCount();
+            jitter.restart();
+        }
+
+        while (xQueueReceive(motorQueue, &command, 0) == pdTRUE)
+        {
+            if (command.action == MotorCommand::Action::Open)
+            {
+                motor.openDoor();
+            }
+            else
+            {
+                motor.closeDoor();
+            }
+            lastCommand = command;
+        }
+        bool currentMotorRunning;
+        {
+            PROFILE_SECTION(MotorRun);
+            if (motorRunning)
+            {
+                // The battery sags under load
+                motor.setMotorVoltage(power.getVoltage_mV());
+            }
+            currentMotorRunning = motor.run();
+        }
+        if (currentMotorRunning)
+        {
+            sendTelemetry(!motorRunning);
+        }
+        if (motorRunning && !currentMotorRunning)
+        {
+            // Motor has stopped
+            ESP_LOGI(TAG, "Motor has stopped");
+            if (!telemetry.isEmpty())
+            {
+                queueTelemetryFrame();
+            }
+            EventBus::Event event = {EventBus::EventType::MotorStopped};
+            event.motorRun.stopReason = motor.getStopReason();
+            event.motorRun.source = lastCommand.source;
+            event.motorRun.opening = lastCommand.action == MotorCommand::Action::Open;
+            event.motorRun.peakCurrent = motor.getPeakCurrent();
+            event.motorRun.travelTime_ms = motor.getTravelTime();
+            bus.post(event);
+        }
+        if (motorRunning != currentMotorRunning)
+        {
+            powerPolicy.setMotorRunning(currentMotorRunning);
+        }
+        motorRunning = currentMotorRunning;
+
+        if (statisticsDelay.isExpired())
+        {
+            statisticsDelay.repeat();
+            jitter.log();
+            logStackHighWaterMark();
+        }
+    }
+}
+
+/**
+ * @brief Dispatches the events.  Blocks on the event bus, only wakes up without an event to poll the RTC alarms.
+ */
+void schedulerTask(void *arg)
+{
+    AsyncDelay statisticsDelay(STATISTICS_PERIOD, AsyncDelay::MILLIS);
+    for (;;)
+    {
+        // Sleep until the next event or the next deadline
+        bus.dispatch(pdMS_TO_TICKS(min(timeUntil(rtcPollingDelay), timeUntil(statisticsDelay))));
+        pollAlarms();
+        publishStatusSnapshot();
+
+        if (statisticsDelay.isExpired())
+        {
+            statisticsDelay.repeat();
+            logStackHighWaterMark();
+#ifdef ENABLE_PROFILER
+            Profiler::dump(Serial);
+#endif
+        }
+    }
+}
+
+/**
+ * @brief Services the webserver and sends the telemetry frames to the web clients.  Only wakes up periodically while the
+ * webserver is active.  Samples the heap usage, and stops the webserver when the heap is running low.  Otherwise publishes the
+ * battery and heap status.
+ */
+void networkTask(void *arg)
+{
+    AsyncDelay statisticsDelay(STATISTICS_PERIOD, AsyncDelay::MILLIS);
+    AsyncDelay heapSampleDelay(HEAP_SAMPLE_PERIOD, AsyncDelay::MILLIS);
+    for (;;)
+    {
+        NetworkMessage message;
+        TickType_t timeout = webserver.isActive() ? pdMS_TO_TICKS(NETWORK_PERIOD) : portMAX_DELAY;
+        if (xQueueReceive(networkQueue, &message, timeout) == pdTRUE)
+        {
+            switch (message.type)
+            {
+            case NetworkMessage::Type::StartWebserver:
+                // Before starting WiFi, which needs the full clock
+                powerPolicy.setWifiActive(true);
+                webserver.setup();
+                break;
+            case NetworkMessage::Type::Telemetry:
+                webserver.sendBinary(message.frame, message.length);
+                break;
+            }
+        }
+        {
+            PROFILE_SECTION(WebserverLoop);
+            webserver.loop();
+        }
+        if (heapSampleDelay.isExpired())
+        {
+            heapSampleDelay.repeat();
+            const HeapMonitor::Sample &sample = heapMonitor.sample();
+            if (heapMonitor.isLow() && webserver.isActive())
+            {
+                // Stop gracefully, before an allocation fails.  The clients only see the websocket close : stop() closes the
+                // connections right away, a message queued now wouldn't be sent.
+                webserver.stop();
+                powerPolicy.setWifiActive(false);
+            }
+            else
+            {
+                webserver.publishStatus(power.getVoltage_percent(), sample.freeHeap, sample.largestBlock);
+            }
+        }
+
+        if (statisticsDelay.isExpired())
+        {
+            statisticsDelay.repeat();
+            logStackHighWaterMark();
+#ifdef ENABLE_PROFILER
+            uint8_t frame[Profiler::MAX_FRAME_SIZE];
+            webserver.sendBinary(frame, Profiler::getFrame(frame, sizeof(frame)));
+#endif
+        }
+    }
+}
+
+/**
+ * @brief Time until a delay expires, 0 when it has expired
+ */
+unsigned long timeUntil(const AsyncDelay &delay)
+{
+    return delay.isExpired() ? 0 : delay.getExpiry() - millis();
+}
+
+void logStackHighWaterMark()
+{
+    ESP_LOGD(TAG, "Task %s: stack high water mark %u bytes", pcTaskGetName(nullptr), uxTaskGetStackHighWaterMark(nullptr));
+}
+
+/**
+ * @brief Publish the status for GET /status, while the webserver is active.  It's only computed again when it has changed, or
+ * when one of the next alarms has passed.
+ * @details When today's alarm has passed, tomorrow's is estimated as 24 hours later, so it can be off by the daily change of the
+ * sun times and on the night of a daylight saving time change.
+ */
+void publishStatusSnapshot()
+{
+    if (!webserver.isActive())
+    {
+        return;
+    }
+    time_t now = time(nullptr);
+    if (!statusChanged && !(statusSnapshot.scheduled && (now >= statusSnapshot.nextOpen || now >= statusSnapshot.nextClose)))
+    {
+        return;
+    }
+    statusChanged = false;
+    StatusSnapshot snapshot = {};
+    snapshot.valid = true;
+    snapshot.door = config.getDoorState();
+    snapshot.mode = static_cast<uint8_t>(config.getDoorControl());
+    time_t openTime, closeTime;
+    // The web clients are shown local times
+    if (timeControl.hasValidTime() && timeControl.useLocalTime() && getScheduleToday(openTime, closeTime))
+    {
+        snapshot.scheduled = true;
+        snapshot.nextOpen = nextAlarmTime(openTime, now);
+        snapshot.nextClose = nextAlarmTime(closeTime, now);
+        formatLocalTime(snapshot.nextOpen, snapshot.nextOpenLocal, sizeof(snapshot.nextOpenLocal));
+        formatLocalTime(snapshot.nextClose, snapshot.nextCloseLocal, sizeof(snapshot.nextCloseLocal));
+    }
+    xSemaphoreTake(statusMutex, portMAX_DELAY);
+    statusSnapshot = snapshot;
+    xSemaphoreGive(statusMutex);
+}
+
+time_t nextAlarmTime(time_t alarmTime, time_t now)
+{
+    return alarmTime <= now ? alarmTime + 24 * 3600 : alarmTime;
+}
+
+void formatLocalTime(time_t utc, char *buffer, size_t size)
+{
+    tm timeinfo;
+    localtime_r(&utc, &timeinfo);
+    strftime(buffer, size, "%Y-%m-%dT%H:%M:%S%z", &timeinfo);
+}
+
+/**
+ * @brief The unit status as JSON, for GET /status.  Written piece by piece, so there's no JSON document.
+ * @details Called in the async_tcp task : it only formats the snapshot published by the scheduler task, and the battery voltage
+ * of the ADC scanner.
+ */
+void printStatus(Print &output)
+{
+    static const char *POSITIONS[] = {"unknown", "open", "closed"};
+    static const char *CONFIDENCES[] = {"none", "started", "assumed", "confirmed"};
+    static const char *MODES[] = {"manual", "fixedTime", "sun"};
+    StatusSnapshot status;
+    xSemaphoreTake(statusMutex, portMAX_DELAY);
+    status = statusSnapshot;
+    xSemaphoreGive(statusMutex);
+    if (status.valid)
+    {
+        const NonVolatileStorage::DoorState &state = status.door;
+        // Values restored from flash are only used as index when in range
+        output.printf("{\"door\":{\"position\":\"%s\",\"confidence\":\"%s\",\"changed\":%lu},",
+                      state.position < 3 ? POSITIONS[state.position] : "unknown",
+                      state.confidence < 4 ? CONFIDENCES[state.confidence] : "none", static_cast<unsigned long>(state.utc));
+        output.printf("\"mode\":\"%s\",", status.mode < 3 ? MODES[status.mode] : "unknown");
+    }
+    else
+    {
+        // The scheduler task hasn't published the status yet, just after the start of the webserver
+        output.print("{\"door\":null,\"mode\":null,");
+    }
+    if (status.scheduled)
     {
-        batteryStatusDelay.repeat();
-        //ESP_LOGI(TAG, "Battery voltage: %d mV", power.getVoltage_mV());
-        webserver.notifyClients("battery", String(power.getVoltage_percent()) + String("%"));
+        printAlarmTime(output, "nextOpen", status.nextOpen, status.nextOpenLocal);
+        printAlarmTime(output, "nextClose", status.nextClose, status.nextCloseLocal);
     }
-    power.run();
+    else
+    {
+        output.print("\"nextOpen\":null,\"nextClose\":null,");
+    }
+    output.printf("\"battery\":{\"mV\":%lu,\"percent\":%lu},", power.getVoltage_mV(), power.getVoltage_percent());
+    output.printf("\"firmware\":\"%s\",\"uptime\":%lu,\"time\":%ld}", COMMIT_HASH, millis() / 1000,
+                  static_cast<long>(time(nullptr)));
+}
 
-    // Handle alarms
-    if (rtcPollingDelay.isExpired() && timeControl.hasValidTime())
+void printAlarmTime(Print &output, const char *name, time_t utc, const char *local)
+{
+    output.printf("\"%s\":{\"utc\":%ld,\"local\":\"%s\"},", name, static_cast<long>(utc), local);
+}
+
+void consoleStats(Print &output, const char *args)
+{
+    output.printf("Uptime: %lu s, CPU: %lu MHz\r\n", millis() / 1000, getCpuFrequencyMhz());
+    output.printf("Battery: %lu mV, %lu%%\r\n", power.getVoltage_mV(), power.getVoltage_percent());
+    output.printf("Motor state: %u, current: %u\r\n", motor.getStateCode(), motor.getCurrent());
+    output.printf("Config writes since boot: %lu\r\n", config.getWriteCount());
+    const NonVolatileStorage::ReadTimes &readTimes = config.getReadTimes();
+    // Print::printf() allocates on the heap for more than 63 characters, so the long lines are split
+    output.printf("Config read times: settings %lu us, ", readTimes.settings_us);
+    output.printf("time zone %lu us, door state %lu us\r\n", readTimes.timeZone_us, readTimes.doorState_us);
+    NonVolatileStorage::DoorState state = config.getDoorState();
+    output.printf("Door position: %u, confidence: %u\r\n", state.position, state.confidence);
+    // nullptr : the console task itself
+    const struct
     {
-        rtcPollingDelay.start(1000, AsyncDelay::MILLIS);
+        TaskHandle_t handle;
+        uint32_t stackSize;
+    } tasks[] = {{motorTaskHandle, MOTOR_TASK_STACK_SIZE},
+                 {schedulerTaskHandle, SCHEDULER_TASK_STACK_SIZE},
+                 {networkTaskHandle, NETWORK_TASK_STACK_SIZE},
+                 {nullptr, Console::TASK_STACK_SIZE}};
+    for (const auto &task : tasks)
+    {
+        // The high water mark is the stack that has never been used, in bytes on the ESP32
+        uint32_t used = task.stackSize - uxTaskGetStackHighWaterMark(task.handle);
+        output.printf("Task %s: ", pcTaskGetName(task.handle));
+        output.printf("stack %lu of %lu bytes used\r\n", used, task.stackSize);
+    }
+#ifdef ENABLE_PROFILER
+    Profiler::dump(output);
+#endif
+}
 
-        if (timeControl.openDoorAlarmTriggered())
+void consoleI2c(Print &output, const char *args)
+{
+    for (uint8_t address = 1; address < 0x7F; address++)
+    {
+        if (detectI2cDevice(address))
         {
-            setCloseDoorAlarm(config.getDoorControl());
-            motor.openDoor();
+            output.printf("Device at 0x%02x\r\n", address);
         }
-        else if (timeControl.closeDoorAlarmTriggered())
+    }
+}
+
+void consoleTrace(Print &output, const char *args)
+{
+    if (strcmp(args, "dump") != 0)
+    {
+        output.println("Usage: trace dump");
+        return;
+    }
+    output.printf("%u records\r\n", TraceLog::dump(output));
+}
+
+/**
+ * @brief List all keys in NVS, with the value of the types this firmware uses
+ */
+void consoleNvs(Print &output, const char *args)
+{
+    if (strcmp(args, "dump") != 0)
+    {
+        output.println("Usage: nvs dump");
+        return;
+    }
+    nvs_iterator_t it = nvs_entry_find(NVS_DEFAULT_PART_NAME, nullptr, NVS_TYPE_ANY);
+    while (it != nullptr)
+    {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        output.printf("%-15s %-15s type 0x%02x", info.namespace_name, info.key, info.type);
+        nvs_handle_t handle;
+        if (nvs_open(info.namespace_name, NVS_READONLY, &handle) == ESP_OK)
         {
-            // Update the sunrise alarm
-            setOpenDoorAlarm(config.getDoorControl());
-            motor.closeDoor();
+            uint8_t u8;
+            char text[33];
+            size_t length = sizeof(text);
+            if (info.type == NVS_TYPE_U8 && nvs_get_u8(handle, info.key, &u8) == ESP_OK)
+            {
+                output.printf(" : %u", u8);
+            }
+            else if (info.type == NVS_TYPE_STR && nvs_get_str(handle, info.key, text, &length) == ESP_OK)
+            {
+                output.printf(" : %s", text);
+            }
+            else if (info.type == NVS_TYPE_BLOB && nvs_get_blob(handle, info.key, nullptr, &length) == ESP_OK)
+            {
+                output.printf(" : %u bytes", length);
+            }
+            nvs_close(handle);
         }
+        output.println();
+        // Releases the iterator after the last entry
+        it = nvs_entry_next(it);
     }
-    if (button.update())
+}
+
+void consoleMotor(Print &output, const char *args)
+{
+    MotorCommand command = {MotorCommand::Action::Open, EventLog::Source::Console};
+    if (strcmp(args, "open") == 0)
     {
-        // Button state has changed
-        handleButtonPress(button.getButton());
+        command.action = MotorCommand::Action::Open;
     }
-    bool currentMotorRunning = motor.run();
-    if (motorRunning && !currentMotorRunning)
+    else if (strcmp(args, "close") == 0)
     {
-        // Motor has stopped
-        ESP_LOGI(TAG, "Motor has stopped");
-        powerOff();
+        command.action = MotorCommand::Action::Close;
+    }
+    else
+    {
+        output.println("Usage: motor open | close");
+        return;
+    }
+    if (xQueueSend(motorQueue, &command, 0) != pdTRUE)
+    {
+        output.println("Motor queue full");
+    }
+}
+
+void consoleRtc(Print &output, const char *args)
+{
+    char text[32];
+    tm timeinfo;
+    if (timeControl.getRtcTime(&timeinfo))
+    {
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &timeinfo);
+        output.printf("RTC: %s UTC\r\n", text);
+    }
+    else
+    {
+        output.println("RTC: no valid time");
+    }
+    time_t now = time(nullptr);
+    gmtime_r(&now, &timeinfo);
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &timeinfo);
+    output.printf("MCU: %s UTC, time %s\r\n", text, timeControl.hasValidTime() ? "valid" : "not valid");
+}
+
+void consoleHeap(Print &output, const char *args)
+{
+    output.printf("Free: %lu bytes, minimum free: %lu bytes, ", ESP.getFreeHeap(), ESP.getMinFreeHeap());
+    output.printf("largest block: %u bytes\r\n", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    heapMonitor.dump(output);
+}
+
+void handleMotorStopped(const EventBus::Event &event)
+{
+    NonVolatileStorage::DoorPosition position =
+        event.motorRun.opening ? NonVolatileStorage::DoorPosition::Open : NonVolatileStorage::DoorPosition::Closed;
+    switch (event.motorRun.stopReason)
+    {
+    case MotorControl::StopReason::EndPosition:
+        config.setDoorState(position, NonVolatileStorage::DoorConfidence::Confirmed);
+        break;
+    case MotorControl::StopReason::Timeout:
+        config.setDoorState(position, NonVolatileStorage::DoorConfidence::Assumed);
+        break;
+    default:
+        // Jammed or no motor : the door may have stopped anywhere
+        config.setDoorState(NonVolatileStorage::DoorPosition::Unknown, NonVolatileStorage::DoorConfidence::None);
+        break;
     }
-    motorRunning = currentMotorRunning;
+    statusChanged = true;
+    eventLog.append(event.motorRun.source, event.motorRun.opening, static_cast<uint8_t>(event.motorRun.stopReason),
+                    event.motorRun.peakCurrent, power.getVoltage_mV(), event.motorRun.travelTime_ms);
+    powerOff();
 }
 
-void webConfigDone()
+void handleConfigReceived(const EventBus::Event &event)
 {
     ESP_LOGI(TAG, "Web config done");
+    config.setGeoLocation(event.config.latitude, event.config.longitude);
+    config.setDoorControl(static_cast<NonVolatileStorage::DoorControl>(event.config.doorControl));
+    config.setFixOpeningTime(event.config.openHour, event.config.openMinute);
+    config.setFixClosingTime(event.config.closeHour, event.config.closeMinute);
     // Save all parameters
     config.saveAll();
+    statusChanged = true;
 
     // Set the alarms
     setOpenDoorAlarm(config.getDoorControl());
@@ -139,11 +717,259 @@ void webConfigDone()
     powerOff();
 }
 
-void updateTime(long utc, const String timezone)
+void handleTimeReceived(const EventBus::Event &event)
+{
+    ESP_LOGI(TAG, "Update time to UTC-seconds: %ld & timezone %s", event.time.utc, event.time.timeZone);
+    config.setTimeZone(event.time.timeZone);
+    timeControl.updateMcuTime(event.time.utc, event.time.timeZone);
+    statusChanged = true;
+}
+
+void handleBatteryLow(const EventBus::Event &event)
+{
+    char line[17];
+    snprintf(line, sizeof(line), "Battery: %lu%%", event.batteryPercent);
+    display.show("Battery low", line);
+}
+
+void handlePowerTimeout(const EventBus::Event &event)
+{
+    powerOff();
+}
+
+/**
+ * @brief The RTC has no interrupt line to the MCU, so the alarm flags are polled.  Triggered alarms are posted as AlarmFired events.
+ */
+void pollAlarms()
+{
+    if (!rtcPollingDelay.isExpired())
+    {
+        return;
+    }
+    rtcPollingDelay.start(RTC_POLLING_PERIOD, AsyncDelay::MILLIS);
+    // Only reconciled at boot, not when the time is set later by the webserver
+    static bool firstPoll = true;
+    bool reconcile = firstPoll;
+    firstPoll = false;
+    if (!timeControl.hasValidTime())
+    {
+        return;
+    }
+    PROFILE_SECTION(RtcPoll);
+    EventBus::Event event = {EventBus::EventType::AlarmFired};
+    if (timeControl.openDoorAlarmTriggered())
+    {
+        event.alarm = EventBus::Alarm::OpenDoor;
+        bus.post(event);
+    }
+    else if (timeControl.closeDoorAlarmTriggered())
+    {
+        event.alarm = EventBus::Alarm::CloseDoor;
+        bus.post(event);
+    }
+    else if (reconcile)
+    {
+        reconcileSchedule();
+    }
+}
+
+/**
+ * @brief Post the last scheduled alarm when it has been missed, e.g. because the batteries were empty at the time.
+ * @details The alarm has been missed when the door state hasn't changed since that alarm and the door isn't in the position of that
+ * alarm.  A door that has been moved by a button after the alarm is left alone.
+ */
+void reconcileSchedule()
+{
+    time_t openTime, closeTime;
+    if (!getScheduleToday(openTime, closeTime))
+    {
+        return;
+    }
+    time_t now = time(nullptr);
+    EventBus::Event event = {EventBus::EventType::AlarmFired};
+    time_t alarmTime;
+    if (now >= closeTime)
+    {
+        event.alarm = EventBus::Alarm::CloseDoor;
+        alarmTime = closeTime;
+    }
+    else if (now >= openTime)
+    {
+        event.alarm = EventBus::Alarm::OpenDoor;
+        alarmTime = openTime;
+    }
+    else
+    {
+        // Yesterday's closing time
+        event.alarm = EventBus::Alarm::CloseDoor;
+        alarmTime = closeTime - 24 * 3600;
+    }
+    NonVolatileStorage::DoorState state = config.getDoorState();
+    NonVolatileStorage::DoorPosition expected =
+        event.alarm == EventBus::Alarm::OpenDoor ? NonVolatileStorage::DoorPosition::Open : NonVolatileStorage::DoorPosition::Closed;
+    if (state.utc >= alarmTime ||
+        (state.getPosition() == expected && state.getConfidence() == NonVolatileStorage::DoorConfidence::Confirmed))
+    {
+        return;
+    }
+    ESP_LOGW(TAG, "Missed the %s alarm at %ld", event.alarm == EventBus::Alarm::OpenDoor ? "open" : "close", (long)alarmTime);
+    bus.post(event);
+}
+
+/**
+ * @brief Today's opening and closing time of the door
+ *
+ * @return false when the door isn't controlled by a schedule
+ */
+bool getScheduleToday(time_t &openTime, time_t &closeTime)
+{
+    uint8_t hour, minute;
+    switch (config.getDoorControl())
+    {
+    case NonVolatileStorage::DoorControl::SunriseSunset:
+        float latitude, longitude;
+        config.getGeoLocation(latitude, longitude);
+        return timeControl.getSunTimesToday(latitude, longitude, openTime, closeTime);
+    case NonVolatileStorage::DoorControl::FixTime:
+        if (!timeControl.useLocalTime())
+        {
+            return false;
+        }
+        config.getFixOpeningTime(hour, minute);
+        openTime = timeControl.getLocalTimeToday(hour, minute);
+        config.getFixClosingTime(hour, minute);
+        closeTime = timeControl.getLocalTimeToday(hour, minute);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Queue a motor command, unless the door is known to be in the requested position already.  The door state is only
+ * accessed by the scheduler task.
+ *
+ * @param force run the motor, also when the end position has been confirmed by the last run
+ * @return true when the command has been queued
+ */
+bool moveDoor(const MotorCommand &command, bool force)
+{
+    NonVolatileStorage::DoorPosition target = command.action == MotorCommand::Action::Open ? NonVolatileStorage::DoorPosition::Open
+                                                                                            : NonVolatileStorage::DoorPosition::Closed;
+    NonVolatileStorage::DoorState state = config.getDoorState();
+    if (state.getPosition() == target)
+    {
+        // Restarting a run in progress would only extend it
+        if (state.getConfidence() == NonVolatileStorage::DoorConfidence::Started ||
+            (!force && state.getConfidence() == NonVolatileStorage::DoorConfidence::Confirmed))
+        {
+            ESP_LOGI(TAG, "Door is already %s", target == NonVolatileStorage::DoorPosition::Open ? "open" : "closed");
+            return false;
+        }
+    }
+    config.setDoorState(target, NonVolatileStorage::DoorConfidence::Started);
+    statusChanged = true;
+    xQueueSend(motorQueue, &command, portMAX_DELAY);
+    return true;
+}
+
+void handleAlarm(const EventBus::Event &event)
+{
+    MotorCommand command = {MotorCommand::Action::Open, EventLog::Source::Alarm};
+    if (event.alarm == EventBus::Alarm::OpenDoor)
+    {
+        setCloseDoorAlarm(config.getDoorControl());
+        command.action = MotorCommand::Action::Open;
+    }
+    else
+    {
+        // Update the sunrise alarm
+        setOpenDoorAlarm(config.getDoorControl());
+        command.action = MotorCommand::Action::Close;
+    }
+    if (!moveDoor(command, false))
+    {
+        // Nothing to do until the next alarm
+        powerOff();
+    }
+}
+
+void startWebserver()
+{
+    displayWifiCredentials();
+    NetworkMessage message;
+    message.type = NetworkMessage::Type::StartWebserver;
+    xQueueSend(networkQueue, &message, portMAX_DELAY);
+}
+
+/**
+ * @brief Sample the motor at 20Hz and send the samples in batches to the web clients
+ *
+ * @param motorStarted true for the first call of a motor run
+ */
+void sendTelemetry(bool motorStarted)
+{
+    if (!webserver.isActive())
+    {
+        return;
+    }
+    if (motorStarted)
+    {
+        telemetry.start();
+        telemetryDelay.start(Telemetry::SAMPLE_PERIOD, AsyncDelay::MILLIS);
+    }
+    if (!telemetryDelay.isExpired())
+    {
+        return;
+    }
+    telemetryDelay.repeat();
+    if (telemetry.addSample(motor.getRawCurrent(), motor.getCurrent(), power.getInstantVoltage_mV(), motor.getStateCode()))
+    {
+        queueTelemetryFrame();
+    }
+}
+
+/**
+ * @brief Hand the telemetry frame over to the network task
+ */
+void queueTelemetryFrame()
+{
+    NetworkMessage message;
+    message.type = NetworkMessage::Type::Telemetry;
+    message.length = telemetry.getFrameSize();
+    memcpy(message.frame, telemetry.getFrame(), message.length);
+    // When the network task can't keep up, the frame is dropped : old samples are of no use for a live view.
+    xQueueSend(networkQueue, &message, 0);
+    telemetry.clearFrame();
+}
+
+/**
+ * @brief Called by the webserver, in the async_tcp task, when a client has sent its configuration
+ * @details The RTC and the settings are only accessed by the scheduler task : the configuration is copied into the events.
+ * The time is posted first, so that the time zone is set when the alarms are programmed.
+ * @return false when the scheduler is too busy to take the configuration
+ */
+bool webConfigReceived(const WsProtocol::Config &webConfig)
 {
-    ESP_LOGI(TAG, "Update time to UTC-seconds: %ld & timezone %s", utc, timezone.c_str());
-    config.setTimeZone(timezone);
-    timeControl.updateMcuTime(utc, timezone);
+    EventBus::Event event = {EventBus::EventType::TimeReceived};
+    event.time.utc = webConfig.utc;
+    static_assert(sizeof(event.time.timeZone) == sizeof(webConfig.timeZone), "Time zone sizes differ");
+    memcpy(event.time.timeZone, webConfig.timeZone, sizeof(event.time.timeZone));
+    event.time.timeZone[sizeof(event.time.timeZone) - 1] = '\0';
+    if (!bus.post(event))
+    {
+        return false;
+    }
+
+    event = {EventBus::EventType::ConfigReceived};
+    event.config.latitude = webConfig.latitude;
+    event.config.longitude = webConfig.longitude;
+    event.config.doorControl = webConfig.doorControl;
+    event.config.openHour = webConfig.openHour;
+    event.config.openMinute = webConfig.openMinute;
+    event.config.closeHour = webConfig.closeHour;
+    event.config.closeMinute = webConfig.closeMinute;
+    return bus.post(event);
 }
 
 /**
@@ -165,7 +991,11 @@ void setOpenDoorAlarm(NonVolatileStorage::DoorControl const doorControl)
         // We have to adapt to daylight saving time, so do the chickens.
         uint8_t hr, min;
         config.getFixOpeningTime(hr, min);
-        assert(timeControl.setOpenAlarmFixTime(hr, min));
+        if (!timeControl.setOpenAlarmFixTime(hr, min))
+        {
+            // The time zone is unknown, it has to be set again
+            startWebserver();
+        }
         break;
     default:
         timeControl.disableAlarms();
@@ -192,7 +1022,10 @@ void setCloseDoorAlarm(NonVolatileStorage::DoorControl const doorControl)
         // We have to adapt to daylight saving time, so do the chickens.
         uint8_t hr, min;
         config.getFixClosingTime(hr, min);
-        assert(timeControl.setCloseAlarmFixTime(hr, min));
+        if (!timeControl.setCloseAlarmFixTime(hr, min))
+        {
+            startWebserver();
+        }
         break;
     default:
         timeControl.disableAlarms();
@@ -200,22 +1033,40 @@ void setCloseDoorAlarm(NonVolatileStorage::DoorControl const doorControl)
     }
 }
 
-void handleButtonPress(ButtonReader::ButtonSelection buttonState)
+void handleButtonEvent(const EventBus::Event &event)
 {
-    switch (buttonState)
+    if (event.button.type == ButtonReader::EventType::Released)
+    {
+        return;
+    }
+    // A long press runs the motor, also when the door is already in position, e.g. after it has been moved by hand
+    bool longPress = event.button.type == ButtonReader::EventType::LongPress;
+    MotorCommand command = {MotorCommand::Action::Open, EventLog::Source::Button};
+    switch (event.button.button)
     {
     case ButtonReader::ButtonSelection::Down:
-        ESP_LOGI(TAG, "Button pressed: Down");
-        motor.closeDoor();
+        ESP_LOGI(TAG, "Button pressed: Down%s", longPress ? " (long)" : "");
+        command.action = MotorCommand::Action::Close;
+        if (!moveDoor(command, longPress) && !longPress)
+        {
+            display.show("Door is closed", "Hold to close");
+        }
         break;
     case ButtonReader::ButtonSelection::Up:
-        ESP_LOGI(TAG, "Button pressed: Up");
-        motor.openDoor();
+        ESP_LOGI(TAG, "Button pressed: Up%s", longPress ? " (long)" : "");
+        command.action = MotorCommand::Action::Open;
+        if (!moveDoor(command, longPress) && !longPress)
+        {
+            display.show("Door is open", "Hold to open");
+        }
         break;
     case ButtonReader::ButtonSelection::Standby:
+        if (longPress)
+        {
+            return;
+        }
         ESP_LOGI(TAG, "Button pressed: Start webserver");
-        displayWifiCredentials();
-        webserver.setup();
+        startWebserver();
         break;
     case ButtonReader::ButtonSelection::None:
     default:
@@ -233,6 +1084,22 @@ void displayWifiCredentials()
     display.show(ssid, password);
 }
 
+/**
+ * @brief Called by TimeControl at the first conversion to local time
+ */
+const char *getTimeZone()
+{
+    return config.getTimeZone();
+}
+
+/**
+ * @brief Called by the power policy.  While idle, the ADC scan only runs when the buttons are used.
+ */
+void idleChanged(bool idle)
+{
+    button.setSleepAllowed(idle);
+}
+
 void powerOff()
 {
     ESP_LOGI(TAG, "Power off");
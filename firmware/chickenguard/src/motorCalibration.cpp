@@ -0,0 +1,178 @@
+#include "motorCalibration.h"
+
+static const char *TAG = "MotorCalibration";
+
+const bool RO_MODE = true;
+const bool RW_MODE = false;
+static const char *NVS_NAMESPACE = "motor";
+static const char *NVS_KEY_STATISTICS = "statistics";
+static const uint8_t STATISTICS_VERSION = 1;
+static const uint16_t MIN_RUN_COUNT = 3;           //!< Learned thresholds are only used after this amount of successful runs
+static const uint16_t MAX_RUN_COUNT = 8;           //!< Older runs fade out with a weight of 1/MAX_RUN_COUNT
+static const unsigned long MAX_DOOR_TIME = 25000;  //!< Learned timeouts will never exceed this value
+static const unsigned long DOOR_TIME_MARGIN = 3000;
+
+MotorCalibration::MotorCalibration()
+{
+    memset(&_statistics, 0, sizeof(_statistics));
+    _statistics.version = STATISTICS_VERSION;
+}
+
+MotorCalibration::~MotorCalibration()
+{
+}
+
+void MotorCalibration::restore()
+{
+    Statistics statistics;
+    _preferences.begin(NVS_NAMESPACE, RO_MODE);
+    size_t len = 0;
+    if (_preferences.isKey(NVS_KEY_STATISTICS))
+    {
+        len = _preferences.getBytes(NVS_KEY_STATISTICS, &statistics, sizeof(statistics));
+    }
+    _preferences.end();
+    if (len != sizeof(statistics) || statistics.version != STATISTICS_VERSION)
+    {
+        ESP_LOGI(TAG, "No motor statistics found, using default limits");
+        return;
+    }
+    _statistics = statistics;
+    ESP_LOGI(TAG, "Raise: %d runs, %.0f +/- %.0f, %lu ms", _statistics.raise.runCount, _statistics.raise.meanCurrent,
+             _statistics.raise.stdDevCurrent, static_cast<unsigned long>(_statistics.raise.travelTime));
+    ESP_LOGI(TAG, "Lower: %d runs, %.0f +/- %.0f, %lu ms", _statistics.lower.runCount, _statistics.lower.meanCurrent,
+             _statistics.lower.stdDevCurrent, static_cast<unsigned long>(_statistics.lower.travelTime));
+}
+
+void MotorCalibration::save()
+{
+    _preferences.begin(NVS_NAMESPACE, RW_MODE);
+    _preferences.putBytes(NVS_KEY_STATISTICS, &_statistics, sizeof(_statistics));
+    _preferences.end();
+}
+
+/**
+ * @brief Update the zero offset of the current sense amplifier
+ * @details To be measured while the motor is off.  The offset is filtered over boots, because a single measurement is noisy.
+ * @param adcOffset ADC-value measured while the motor is off
+ */
+void MotorCalibration::setZeroOffset(float adcOffset)
+{
+    if (_statistics.raise.runCount == 0 && _statistics.lower.runCount == 0)
+    {
+        _statistics.zeroOffset = adcOffset;
+    }
+    else
+    {
+        _statistics.zeroOffset += (adcOffset - _statistics.zeroOffset) / MAX_RUN_COUNT;
+    }
+    ESP_LOGI(TAG, "Current sense zero offset: %.1f", _statistics.zeroOffset);
+}
+
+float MotorCalibration::getZeroOffset() const
+{
+    return _statistics.zeroOffset;
+}
+
+void MotorCalibration::startRun(Direction direction, float motorVoltage_mV)
+{
+    _direction = direction;
+    _runVoltageScale = voltageScale(motorVoltage_mV);
+    _sampleCount = 0;
+    _sampleSum = 0;
+    _sampleSquareSum = 0;
+}
+
+/**
+ * @brief Add a current sample of the door travelling normally (i.e. not pulling up loose rope and not at an end position)
+ *
+ * @param current ADC-value, including zero offset
+ */
+void MotorCalibration::addSample(uint16_t current)
+{
+    _sampleCount++;
+    _sampleSum += current;
+    _sampleSquareSum += (uint32_t)current * current;
+}
+
+/**
+ * @brief Finish the run and learn from it
+ * @details A timeout while the door was moving normally means that the learned travel time is too short : the door takes at
+ * least as long as this run.  Without this, a timeout learned too tight could never grow back, as timed out runs aren't learned.
+ * A run that ends much sooner than the learned travel time has hit an obstacle (a jam while raising also ends on overload).
+ * Its currents are learned, but not its travel time, so that jams don't shrink the timeout.
+ * @param result how the run ended
+ * @param travelTime_ms time the door has been moving, from the end of the dead time until the end position
+ */
+void MotorCalibration::endRun(RunResult result, unsigned long travelTime_ms)
+{
+    const uint32_t MIN_SAMPLE_COUNT = 10;
+    DirectionStatistics &statistics = (_direction == Direction::Raise) ? _statistics.raise : _statistics.lower;
+    if (result == RunResult::Timeout && statistics.runCount > 0 && travelTime_ms > statistics.travelTime)
+    {
+        statistics.travelTime = min(travelTime_ms, MAX_DOOR_TIME);
+        ESP_LOGI(TAG, "Timeout, travel time raised to %lu ms", static_cast<unsigned long>(statistics.travelTime));
+        save();
+        return;
+    }
+    if (result != RunResult::EndPosition || _sampleCount < MIN_SAMPLE_COUNT)
+    {
+        ESP_LOGI(TAG, "Run not used for learning");
+        return;
+    }
+    bool learnTravelTime = statistics.runCount < MIN_RUN_COUNT || 4 * travelTime_ms >= 3 * statistics.travelTime;
+    double rawMean = (double)_sampleSum / _sampleCount;
+    float variance = ((double)_sampleSquareSum - rawMean * _sampleSum) / (_sampleCount - 1);
+    float sampleMean = (rawMean - _statistics.zeroOffset) / _runVoltageScale;
+    float stdDev = sqrtf(max(variance, 0.0f)) / _runVoltageScale;
+    if (statistics.runCount < MAX_RUN_COUNT)
+    {
+        statistics.runCount++;
+    }
+    // Plain average for the first runs, exponential moving average afterwards
+    statistics.meanCurrent += (sampleMean - statistics.meanCurrent) / statistics.runCount;
+    statistics.stdDevCurrent += (stdDev - statistics.stdDevCurrent) / statistics.runCount;
+    if (learnTravelTime)
+    {
+        statistics.travelTime += ((long)travelTime_ms - (long)statistics.travelTime) / statistics.runCount;
+    }
+    ESP_LOGI(TAG, "Run learned: %.0f +/- %.0f, %lu ms%s", sampleMean, stdDev, travelTime_ms,
+             learnTravelTime ? "" : " (travel time too short, not learned)");
+    save();
+}
+
+/**
+ * @brief Derive the current limits and timeouts from the learned statistics
+ *
+ * @param motorVoltage_mV
+ * @param thresholds current limits in ADC-values including zero offset and timeouts in ms
+ * @return true when enough runs in both directions have been learned, else false and thresholds is not changed.
+ */
+bool MotorCalibration::getThresholds(float motorVoltage_mV, Thresholds &thresholds) const
+{
+    if (_statistics.raise.runCount < MIN_RUN_COUNT || _statistics.lower.runCount < MIN_RUN_COUNT)
+    {
+        return false;
+    }
+    const DirectionStatistics &raise = _statistics.raise;
+    const DirectionStatistics &lower = _statistics.lower;
+    float scale = voltageScale(motorVoltage_mV);
+    float offset = _statistics.zeroOffset;
+
+    // Margins are a multiple of the noise, but never smaller than a fraction of the mean current
+    thresholds.raisingOverload = offset + scale * (raise.meanCurrent + max(4 * raise.stdDevCurrent, 0.3f * raise.meanCurrent));
+    thresholds.raisingUnderload = offset + scale * (raise.meanCurrent - max(3 * raise.stdDevCurrent, 0.25f * raise.meanCurrent));
+    thresholds.loweringOverload = offset + scale * (lower.meanCurrent + max(4 * lower.stdDevCurrent, 0.3f * lower.meanCurrent));
+    thresholds.noMotor = offset + scale * 0.5f * min(lower.meanCurrent, raise.meanCurrent);
+    thresholds.raiseDoorTime = min(MAX_DOOR_TIME, static_cast<unsigned long>(raise.travelTime + raise.travelTime / 4) + DOOR_TIME_MARGIN);
+    thresholds.lowerDoorTime = min(MAX_DOOR_TIME, static_cast<unsigned long>(lower.travelTime + lower.travelTime / 4) + DOOR_TIME_MARGIN);
+    return true;
+}
+
+/**
+ * @brief Same model as MotorControl::limitConversion : current at 6V is 20% higher than at 4.5V
+ */
+float MotorCalibration::voltageScale(float motorVoltage_mV)
+{
+    return 1.0f + 0.133f * (motorVoltage_mV - 4500) * 1e-3f;
+}
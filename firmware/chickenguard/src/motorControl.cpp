@@ -1,11 +1,12 @@
 #include "motorControl.h"
+#include "traceLog.h"
 
 static const char *TAG = "MotorControl";
 
-MotorControl::MotorControl(uint8_t pinIn1, uint8_t pinIn2, uint8_t pinCurrentSense) : _pinIn1(pinIn1),
-                                                                                      _pinIn2(pinIn2),
-                                                                                      _pinCurrentSense(pinCurrentSense),
-                                                                                      _currentSense(20)
+MotorControl::MotorControl(uint8_t pinIn1, uint8_t pinIn2, AdcScanner &adc, uint8_t pinCurrentSense) : _pinIn1(pinIn1),
+                                                                                                       _pinIn2(pinIn2),
+                                                                                                       _adc(adc),
+                                                                                                       _pinCurrentSense(pinCurrentSense)
 {
 }
 
@@ -17,14 +18,61 @@ void MotorControl::init(float motorVoltage)
 {
     pinMode(_pinIn1, OUTPUT);
     pinMode(_pinIn2, OUTPUT);
+    digitalWrite(_pinIn1, LOW);
+    digitalWrite(_pinIn2, LOW);
     off();
-    _AdcSamplingPeriod.start(50, AsyncDelay::MILLIS);
-    ESP_LOGI(TAG, "Motor voltage: %f", motorVoltage);
+    TRACE(MOTOR, INFO, MotorVoltage, motorVoltage, 0);
+    _motorVoltage = motorVoltage;
     // Limits for current, in mA, measured at VMOTOR=4.5V
     RAISING_UNDERLOAD_CURRENT = limitConversion(1050, motorVoltage);
     RAISING_OVERLOAD_CURRENT = limitConversion(1700, motorVoltage);
     LOWERING_OVERLOAD_CURRENT = limitConversion(580, motorVoltage);
     NO_MOTOR_CURRENT = limitConversion(250, motorVoltage);
+
+    // Replace the default limits by the ones learned from previous runs on this door, if available.
+    _calibration.restore();
+    float zeroOffset;
+    if (measureZeroOffset(zeroOffset))
+    {
+        _calibration.setZeroOffset(zeroOffset);
+    }
+    else
+    {
+        // Keep the learned offset : the thresholds are stored relative to it
+        ESP_LOGE(TAG, "No current sense reading, zero offset not measured");
+    }
+    MotorCalibration::Thresholds thresholds;
+    if (_calibration.getThresholds(motorVoltage, thresholds))
+    {
+        RAISING_UNDERLOAD_CURRENT = thresholds.raisingUnderload;
+        RAISING_OVERLOAD_CURRENT = thresholds.raisingOverload;
+        LOWERING_OVERLOAD_CURRENT = thresholds.loweringOverload;
+        NO_MOTOR_CURRENT = thresholds.noMotor;
+        RAISE_DOOR_TIME = thresholds.raiseDoorTime;
+        LOWER_DOOR_TIME = thresholds.lowerDoorTime;
+        ESP_LOGI(TAG, "Learned limits: raising %u..%u, lowering < %u, no motor < %u, timeouts %lu/%lu ms",
+                 RAISING_UNDERLOAD_CURRENT, RAISING_OVERLOAD_CURRENT, LOWERING_OVERLOAD_CURRENT, NO_MOTOR_CURRENT,
+                 RAISE_DOOR_TIME, LOWER_DOOR_TIME);
+    }
+}
+
+/**
+ * @brief Update the motor voltage measured while the motor is running
+ * @details The limits are set for the voltage at init(), which is measured without load.  A weak battery sags under load, and
+ * the current drops with the voltage.  The samples are scaled back to the voltage at init(), so that a sagging battery doesn't
+ * look like a loose rope.
+ * @param motorVoltage_mV
+ */
+void MotorControl::setMotorVoltage(float motorVoltage_mV)
+{
+    // Below this, the reading is wrong : even a stalled motor on a weak battery keeps more.
+    const float MIN_MOTOR_VOLTAGE = 1000;
+    if (_motorVoltage < MIN_MOTOR_VOLTAGE || motorVoltage_mV < MIN_MOTOR_VOLTAGE)
+    {
+        _loadScale = 1.0f;
+        return;
+    }
+    _loadScale = MotorCalibration::voltageScale(_motorVoltage) / MotorCalibration::voltageScale(motorVoltage_mV);
 }
 
 /**
@@ -35,11 +83,9 @@ void MotorControl::init(float motorVoltage)
 bool MotorControl::run()
 {
     const unsigned long DEAD_TIME = 3000;
-    const unsigned long RAISE_DOOR_TIME = 25000;
-    const unsigned long LOWER_DOOR_TIME = 25000;
     const unsigned long LOOSE_ROPE_TIME = 5000;
 
-    float current = 0;
+    uint16_t current = 0;
 
     switch (_state)
     {
@@ -54,7 +100,12 @@ bool MotorControl::run()
         _motorOnTime.start(DEAD_TIME, AsyncDelay::MILLIS);
         _currentSense.clear();
         _direction = MotorDirection::Raise;
-        _state = MotorState::dead_time;
+        _stopReason = StopReason::None;
+        _peakCurrent = 0;
+        _loadScale = 1.0f;
+        _calibration.startRun(MotorCalibration::Direction::Raise, _motorVoltage);
+        _trace.begin(0, _motorVoltage);
+        setState(MotorState::dead_time);
         return true;
     case MotorState::start_lower:
         digitalWrite(_pinIn1, HIGH);
@@ -62,14 +113,20 @@ bool MotorControl::run()
         _motorOnTime.start(DEAD_TIME, AsyncDelay::MILLIS);
         _currentSense.clear();
         _direction = MotorDirection::Lower;
-        _state = MotorState::dead_time;
+        _stopReason = StopReason::None;
+        _peakCurrent = 0;
+        _loadScale = 1.0f;
+        _calibration.startRun(MotorCalibration::Direction::Lower, _motorVoltage);
+        _trace.begin(1, _motorVoltage);
+        setState(MotorState::dead_time);
         return true;
     case MotorState::dead_time:
         // Wait for the motor to start and for the current to stabilize
         if (_motorOnTime.isExpired())
         {
             _motorOnTime.start((_direction == MotorDirection::Raise) ? RAISE_DOOR_TIME : LOWER_DOOR_TIME, AsyncDelay::MILLIS);
-            _state = MotorState::running;
+            _travelStartTime = millis();
+            setState(MotorState::running);
         }
         return true;
     case MotorState::raising_under_load:
@@ -77,54 +134,65 @@ bool MotorControl::run()
         if (_motorOnTime.isExpired())
         {
             // We won't be pulling up loose rope forever.
-            _state = MotorState::Off;
+            stop(StopReason::Timeout);
+            return true;
         }
-        if (readAdc(current))
+        // Only evaluate the limits when there's a new sample.
+        if (!readAdc(current))
         {
-            ESP_LOGI(TAG, "Underload current: %2f < %2f", current, RAISING_UNDERLOAD_CURRENT);
+            return true;
         }
+        TRACE(MOTOR, DEBUG, Underload, current, RAISING_UNDERLOAD_CURRENT);
         if (current < NO_MOTOR_CURRENT)
         {
-            ESP_LOGI(TAG, "No motor current detected: %2f < %2f", current, NO_MOTOR_CURRENT);
-            _state = MotorState::Off;
+            TRACE(MOTOR, INFO, NoCurrent, current, NO_MOTOR_CURRENT);
+            stop(StopReason::NoCurrent);
         }
-        if (current > RAISING_UNDERLOAD_CURRENT)
+        else if (current > RAISING_UNDERLOAD_CURRENT)
         {
-            ESP_LOGI(TAG, "Underload condition ended");
+            TRACE(MOTOR, INFO, UnderloadEnded, current, 0);
             _motorOnTime.start(RAISE_DOOR_TIME, AsyncDelay::MILLIS);
-            _state = MotorState::running;
+            setState(MotorState::running);
         }
         return true;
     case MotorState::running:
         if (_motorOnTime.isExpired())
         {
-            _state = MotorState::Off;
+            stop(StopReason::Timeout);
+            return true;
         }
-        if (readAdc(current))
+        if (!readAdc(current))
         {
-            ESP_LOGI(TAG, "Current: %f", current);
+            return true;
         }
+        TRACE(MOTOR, DEBUG, MotorCurrent, current, 0);
         if (current < NO_MOTOR_CURRENT)
         {
-            ESP_LOGI(TAG, "No motor current detected: %2f < %2f", current, NO_MOTOR_CURRENT);
-            _state = MotorState::Off;
+            TRACE(MOTOR, INFO, NoCurrent, current, NO_MOTOR_CURRENT);
+            stop(StopReason::NoCurrent);
         }
-        if (current > RAISING_OVERLOAD_CURRENT)
+        else if (current > RAISING_OVERLOAD_CURRENT)
         {
-            ESP_LOGI(TAG, "Overload current detected: %2f > %2f", current, RAISING_OVERLOAD_CURRENT);
-            _state = MotorState::Off;
+            TRACE(MOTOR, INFO, Overload, current, RAISING_OVERLOAD_CURRENT);
+            // When raising, the door has been pulled against the top stop.
+            stop(_direction == MotorDirection::Raise ? StopReason::EndPosition : StopReason::Overload);
         }
-        if (_direction == MotorDirection::Raise && current < RAISING_UNDERLOAD_CURRENT)
+        else if (_direction == MotorDirection::Raise && current < RAISING_UNDERLOAD_CURRENT)
         {
             // The motor is pulling up loose rope.
-            ESP_LOGI(TAG, "Raising underload current detected: %2f < %2f", current, RAISING_UNDERLOAD_CURRENT);
+            TRACE(MOTOR, INFO, RaisingUnderload, current, RAISING_UNDERLOAD_CURRENT);
             _motorOnTime.start(LOOSE_ROPE_TIME, AsyncDelay::MILLIS);
-            _state = MotorState::raising_under_load;
+            setState(MotorState::raising_under_load);
         }
-        if (_direction == MotorDirection::Lower && current > LOWERING_OVERLOAD_CURRENT)
+        else if (_direction == MotorDirection::Lower && current > LOWERING_OVERLOAD_CURRENT)
         {
-            ESP_LOGI(TAG, "Lowering overload current detected: %2f > %2f", current, LOWERING_OVERLOAD_CURRENT);
-            _state = MotorState::Off;
+            // The door is down and the rope is being wound up in the wrong direction.
+            TRACE(MOTOR, INFO, LoweringOverload, current, LOWERING_OVERLOAD_CURRENT);
+            stop(StopReason::EndPosition);
+        }
+        else
+        {
+            _calibration.addSample(current);
         }
         return true;
     default:
@@ -133,6 +201,38 @@ bool MotorControl::run()
     }
 }
 
+/**
+ * @brief Stop the motor (at the next call of run()) and learn from the run when the end position has been reached, or when the
+ * door was still moving normally at the timeout.
+ *
+ * @param reason
+ */
+void MotorControl::stop(StopReason reason)
+{
+    MotorCalibration::RunResult result = MotorCalibration::RunResult::Failed;
+    if (reason == StopReason::EndPosition)
+    {
+        result = MotorCalibration::RunResult::EndPosition;
+    }
+    else if (reason == StopReason::Timeout && _state == MotorState::running)
+    {
+        // The current was normal all along : the door was still moving.
+        result = MotorCalibration::RunResult::Timeout;
+    }
+    _stopReason = reason;
+    _trace.addEvent(MotorTrace::EventType::Stop, static_cast<uint8_t>(reason));
+    setState(MotorState::Off);
+    _trace.end();
+    _travelTime = millis() - _travelStartTime;
+    _calibration.endRun(result, _travelTime);
+}
+
+void MotorControl::setState(MotorState state)
+{
+    _state = state;
+    _trace.addEvent(MotorTrace::EventType::State, static_cast<uint8_t>(state));
+}
+
 void MotorControl::openDoor()
 {
     _state = MotorState::start_raise;
@@ -148,16 +248,48 @@ void MotorControl::off()
     _state = MotorState::Off;
 }
 
-bool MotorControl::readAdc(float &current)
+/**
+ * @brief Get the filtered motor current
+ *
+ * @param current
+ * @return true when the ADC scanner has published a new sample since the previous call
+ */
+bool MotorControl::readAdc(uint16_t &current)
 {
-    if (_AdcSamplingPeriod.isExpired())
+    AdcScanner::Reading reading;
+    if (!_adc.getReading(_pinCurrentSense, reading) || reading.count == _lastReadingCount)
     {
-        _AdcSamplingPeriod.start(50, AsyncDelay::MILLIS);
-        _currentSense.addValue(analogRead(_pinCurrentSense));
-        current = _currentSense.getAverage();
-        return true;
+        return false;
+    }
+    _lastReadingCount = reading.count;
+    // Each sample is already the mean of the conversions during ADC_PERIOD
+    uint16_t sample = reading.filteredRaw;
+    _lastSample = sample;
+    _trace.addSample(sample);
+    float offset = _calibration.getZeroOffset();
+    float scaled = offset + (sample - offset) * _loadScale;
+    _currentSense.add(static_cast<uint16_t>(constrain(scaled, 0.0f, 4095.0f)));
+    current = _currentSense.get();
+    _peakCurrent = max(_peakCurrent, current);
+    return true;
+}
+
+/**
+ * @brief Measure the output of the current sense amplifier while the motor is off
+ *
+ * @param offset average ADC-value over ADC_PERIOD
+ * @return true when the ADC scanner has provided a reading
+ */
+bool MotorControl::measureZeroOffset(float &offset)
+{
+    AdcScanner::Reading reading;
+    if (!_adc.waitForReading(_pinCurrentSense, reading, 10 * ADC_PERIOD))
+    {
+        return false;
     }
-    return false;
+    _lastReadingCount = reading.count;
+    offset = reading.filteredRaw;
+    return true;
 }
 
 void MotorControl::demo()
@@ -180,12 +312,12 @@ void MotorControl::demo()
  *  Then the rico (a) is (1.2 * y - y) / (6V - 4.5V) = 0.2 * y / 1.5V = 2/15 * y
  *  And the new limit (x) is y + a * (Vmotor - 4.5V)
  * @param currentLimit4V5
- * @return float
+ * @return uint16_t
  */
-float MotorControl::limitConversion(float currentLimit4V5, float motorVoltage_mV)
+uint16_t MotorControl::limitConversion(float currentLimit4V5, float motorVoltage_mV)
 {
     float rico = 0.133 * currentLimit4V5;
-    float newLimit = currentLimit4V5 + rico * (motorVoltage_mV - 4500) * 1e-3f;
-    ESP_LOGI(TAG, "Current limit at 4.5V: %2f mA, new limit: %2f", currentLimit4V5, newLimit);
+    uint16_t newLimit = currentLimit4V5 + rico * (motorVoltage_mV - 4500) * 1e-3f;
+    TRACE(MOTOR, INFO, CurrentLimit, currentLimit4V5, newLimit);
     return newLimit;
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "motorTrace.h"
+#include "Preferences.h"
+
+static const char *TAG = "MotorTrace";
+
+const bool RO_MODE = true;
+const bool RW_MODE = false;
+static const char *NVS_NAMESPACE = "trace";
+static const char *NVS_KEY_NEXT = "next";
+static const uint16_t TRACE_MAGIC = 0x5254; // "TR"
+static const uint8_t TRACE_VERSION = 1;
+static const size_t MAX_TOKEN_SIZE = 11;    // event : 3 varints
+
+static void traceKey(char *key, size_t index)
+{
+    sprintf(key, "run%u", (unsigned)index);
+}
+
+MotorTrace::MotorTrace()
+{
+}
+
+MotorTrace::~MotorTrace()
+{
+}
+
+/**
+ * @brief Start recording a new run
+ *
+ * @param direction 0 = raise, 1 = lower
+ * @param motorVoltage_mV
+ */
+void MotorTrace::begin(uint8_t direction, uint16_t motorVoltage_mV)
+{
+    memset(&_header, 0, sizeof(_header));
+    _header.magic = TRACE_MAGIC;
+    _header.version = TRACE_VERSION;
+    _header.direction = direction;
+    _header.utc = time(nullptr);
+    _header.motorVoltage_mV = motorVoltage_mV;
+    _length = 0;
+    _lastSample = 0;
+    _lastTokenTime = millis();
+    _active = true;
+}
+
+void MotorTrace::addSample(uint16_t adcValue)
+{
+    if (!_active)
+    {
+        return;
+    }
+    int32_t delta = (int32_t)adcValue - (int32_t)_lastSample;
+    uint32_t zigzag = (uint32_t)((delta << 1) ^ (delta >> 31));
+    // Keep room for the events that end the run
+    if (_length + 2 * MAX_TOKEN_SIZE > MAX_TRACE_SIZE)
+    {
+        _header.flags |= FLAG_TRUNCATED;
+        return;
+    }
+    putToken(zigzag << 1);
+    _lastSample = adcValue;
+}
+
+void MotorTrace::addEvent(EventType type, uint8_t value)
+{
+    if (!_active || _length + MAX_TOKEN_SIZE > MAX_TRACE_SIZE)
+    {
+        return;
+    }
+    putToken((static_cast<uint32_t>(type) << 1) | 1);
+    putVarint(value);
+}
+
+/**
+ * @brief Stop recording and store the trace in NVS, overwriting the oldest one.
+ */
+void MotorTrace::end()
+{
+    if (!_active)
+    {
+        return;
+    }
+    _active = false;
+    _header.length = _length;
+
+    Preferences preferences;
+    preferences.begin(NVS_NAMESPACE, RW_MODE);
+    uint8_t next = preferences.getUChar(NVS_KEY_NEXT, 0) % TRACE_COUNT;
+    char key[8];
+    traceKey(key, next);
+    // Header and data are stored as a single blob
+    static uint8_t blob[sizeof(Header) + MAX_TRACE_SIZE];
+    memcpy(blob, &_header, sizeof(Header));
+    memcpy(blob + sizeof(Header), _data, _length);
+    if (preferences.putBytes(key, blob, sizeof(Header) + _length) == 0)
+    {
+        ESP_LOGE(TAG, "Can't store trace %s", key);
+    }
+    preferences.putUChar(NVS_KEY_NEXT, (next + 1) % TRACE_COUNT);
+    preferences.end();
+    ESP_LOGI(TAG, "Trace %s stored: %u bytes", key, (unsigned)_length);
+}
+
+/**
+ * @brief Write all stored traces, oldest first.
+ *
+ * @param out destination, e.g. a webserver response
+ * @return size_t number of bytes written
+ */
+size_t MotorTrace::dump(Print &out)
+{
+    static uint8_t blob[sizeof(Header) + MAX_TRACE_SIZE];
+    size_t written = 0;
+    Preferences preferences;
+    if (!preferences.begin(NVS_NAMESPACE, RO_MODE))
+    {
+        // Namespace doesn't exist yet : no traces recorded
+        return 0;
+    }
+    uint8_t next = preferences.getUChar(NVS_KEY_NEXT, 0);
+    for (size_t i = 0; i < TRACE_COUNT; i++)
+    {
+        char key[8];
+        traceKey(key, (next + i) % TRACE_COUNT);
+        if (!preferences.isKey(key))
+        {
+            continue;
+        }
+        size_t len = preferences.getBytes(key, blob, sizeof(blob));
+        written += out.write(blob, len);
+    }
+    preferences.end();
+    return written;
+}
+
+bool MotorTrace::putVarint(uint32_t value)
+{
+    do
+    {
+        if (_length >= MAX_TRACE_SIZE)
+        {
+            return false;
+        }
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        _data[_length++] = value ? (byte | 0x80) : byte;
+    } while (value);
+    return true;
+}
+
+bool MotorTrace::putToken(uint32_t header)
+{
+    unsigned long now = millis();
+    bool ok = putVarint(header) && putVarint(now - _lastTokenTime);
+    _lastTokenTime = now;
+    return ok;
+}
@@ -1,69 +1,127 @@
 #include "powerControl.h"
 #include "pins.h"
+#include "eventBus.h"
+#include "profiler.h"
 
 static const char *TAG = "powerControl";
 
-powerControl::powerControl(const BatteryTech batteryTech, const uint32_t cellCount, const float voltageDividerScale) : _batteryTech(batteryTech),
-                                                                                                                       _cellCount(cellCount),
-                                                                                                                       _voltageDividerScale(voltageDividerScale)
+powerControl::powerControl(AdcScanner &adc, EventBus &bus, const BatteryTech batteryTech, const uint32_t cellCount,
+                           const float voltageDividerScale) : _adc(adc),
+                                                              _bus(bus),
+                                                              _batteryTech(batteryTech),
+                                                              _cellCount(cellCount),
+                                                              _voltageDividerScale(voltageDividerScale)
 {
 }
 
+/**
+ * @brief Take over the power enable and start monitoring the battery and the powered on period in the background.
+ * @details Waits for the first battery reading of the ADC scanner, so that getVoltage_mV() has a value from then on.  This is the
+ * only place that blocks on the ADC : it's called from setup().
+ */
 bool powerControl::init()
 {
     pinMode(EN_PWR, OUTPUT);
     digitalWrite(EN_PWR, HIGH); // take over power enable pin from momentary switch to keep power on when user releases button.
     _powerOnPeriod.start(POWERED_ON_PERIOD, AsyncDelay::MILLIS);
+    AdcScanner::Reading reading;
+    if (!_adc.waitForReading(SNS_VMOTOR, reading, 10 * ADC_PERIOD))
+    {
+        ESP_LOGE(TAG, "No battery reading");
+    }
 
     pinMode(LED_PIN, OUTPUT);
     digitalWrite(LED_PIN, HIGH); // turn LED on, don't wait for timer to expire first.
-    _ledBlinkDelay.start(LED_BLINK_PERIOD, AsyncDelay::MILLIS);
 
-    return true;
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = &powerControl::onTimer;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "power";
+    if (esp_timer_create(&timerArgs, &_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't create power timer");
+        return false;
+    }
+    return esp_timer_start_periodic(_timer, BATTERY_CHECK_PERIOD * 1000) == ESP_OK;
 }
 
-void powerControl::run()
+void powerControl::onTimer(void *arg)
 {
-    if (_powerOnPeriod.isExpired())
+    static_cast<powerControl *>(arg)->update();
+}
+
+/**
+ * @brief Runs in the esp_timer task : blink the LED while the battery is low and post the power events.
+ * @details Runs every BATTERY_CHECK_PERIOD, only while the battery is low at the faster LED_BLINK_PERIOD.
+ */
+void powerControl::update()
+{
+    PROFILE_SECTION(BatteryCheck);
+    if (!_powerTimeoutPosted && _powerOnPeriod.isExpired())
     {
         ESP_LOGD(TAG, "Time on period expired");
-        powerOff();
+        EventBus::Event event = {EventBus::EventType::PowerTimeout};
+        _powerTimeoutPosted = _bus.post(event);
     }
-    if (_ledBlinkDelay.isExpired())
+    if (getVoltage_mV() == 0)
     {
-        _ledBlinkDelay.repeat();
-        if (getVoltage_percent() < LOW_BATTERY_PERCENT)
+        // No reading yet : the battery isn't empty
+        return;
+    }
+    uint32_t percent = getVoltage_percent();
+    if (percent < LOW_BATTERY_PERCENT)
+    {
+        if (!_batteryLow)
         {
             ESP_LOGE(TAG, "Battery voltage is too low");
-            _batteryLow = true;
-            digitalWrite(LED_PIN, !digitalRead(LED_PIN));
+            EventBus::Event event = {EventBus::EventType::BatteryLow};
+            event.batteryPercent = percent;
+            _bus.post(event);
+            esp_timer_stop(_timer);
+            esp_timer_start_periodic(_timer, LED_BLINK_PERIOD * 1000);
         }
-        else
+        _batteryLow = true;
+        digitalWrite(LED_PIN, !digitalRead(LED_PIN));
+    }
+    else
+    {
+        if (_batteryLow)
         {
-            _batteryLow = false;
-            digitalWrite(LED_PIN, LOW); // turn LED off
+            esp_timer_stop(_timer);
+            esp_timer_start_periodic(_timer, BATTERY_CHECK_PERIOD * 1000);
         }
+        _batteryLow = false;
+        digitalWrite(LED_PIN, LOW); // turn LED off
     }
 }
 
+/**
+ * @brief Battery voltage, averaged over ADC_PERIOD by the ADC scanner, which also averages out the spikes caused by the motor.
+ * @details Doesn't block : it's called from the esp_timer task and from the motor task.
+ * @return 0 when the ADC scanner has no reading yet
+ */
 uint32_t powerControl::getVoltage_mV()
 {
-    const int SAMPLE_COUNT = 10;
-    int adcValue = 0;
-    const uint32_t MAX_mV_MEASUREMENT = 3500;
+    AdcScanner::Reading reading;
+    if (!_adc.getReading(SNS_VMOTOR, reading))
+    {
+        return 0;
+    }
+    return reading.filtered_mV * _voltageDividerScale;
+}
 
-    int sampleCount = 0;
-    while (sampleCount < SAMPLE_COUNT)
+/**
+ * @brief Latest, unfiltered measurement of the battery voltage.
+ */
+uint32_t powerControl::getInstantVoltage_mV()
+{
+    AdcScanner::Reading reading;
+    if (!_adc.getReading(SNS_VMOTOR, reading))
     {
-        uint32_t measurement = analogReadMilliVolts(SNS_VMOTOR);
-        if (measurement < MAX_mV_MEASUREMENT)
-        {
-            adcValue += measurement;
-            sampleCount++;
-        }
-        delay(1);
+        return 0;
     }
-    return adcValue * _voltageDividerScale / SAMPLE_COUNT;
+    return reading.mV * _voltageDividerScale;
 }
 
 /**
@@ -89,6 +147,15 @@ uint32_t powerControl::getVoltage_percent()
         maxVoltage = 1200;
         break;
     }
+    // An empty battery must be reported as 0%, not wrap around
+    if (voltage <= minVoltage)
+    {
+        return 0;
+    }
+    if (voltage >= maxVoltage)
+    {
+        return 100;
+    }
     uint32_t range = maxVoltage - minVoltage;
     uint32_t voltageInRange = voltage - minVoltage;
     uint32_t percent = voltageInRange * 100 / range;
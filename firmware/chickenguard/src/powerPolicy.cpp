@@ -0,0 +1,97 @@
+#include "powerPolicy.h"
+#include <esp_pm.h>
+
+static const char *TAG = "PowerPolicy";
+
+/**
+ * @brief Indexed by Mode.  WiFi needs an 80MHz APB clock, which the WiFi driver enforces itself while the radio is on.
+ */
+const PowerPolicy::Setting PowerPolicy::SETTINGS[] = {
+    {40, 10, true},   // Idle : waiting for an event
+    {80, 40, true},   // MotorRunning : 10ms control period, NVS writes at the end of the run
+    {160, 80, false}, // WifiActive
+};
+
+PowerPolicy::PowerPolicy()
+{
+}
+
+PowerPolicy::~PowerPolicy()
+{
+}
+
+/**
+ * @brief Apply the idle mode.  Set the idle handler before.
+ *
+ * @return true when successful
+ */
+bool PowerPolicy::begin()
+{
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+    if (_mutex == nullptr)
+    {
+        return false;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    apply();
+    xSemaphoreGive(_mutex);
+    return true;
+}
+
+void PowerPolicy::setMotorRunning(bool running)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _motorRunning = running;
+    apply();
+    xSemaphoreGive(_mutex);
+}
+
+void PowerPolicy::setWifiActive(bool active)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _wifiActive = active;
+    apply();
+    xSemaphoreGive(_mutex);
+}
+
+/**
+ * @brief Configure the power management for the current mode.  Must be called with the mutex taken.
+ */
+void PowerPolicy::apply()
+{
+    Mode mode = _wifiActive ? Mode::WifiActive : _motorRunning ? Mode::MotorRunning : Mode::Idle;
+    if (_applied && mode == _mode)
+    {
+        return;
+    }
+    _mode = mode;
+    _applied = true;
+    if (_idleHandler != nullptr)
+    {
+        _idleHandler(mode == Mode::Idle);
+    }
+    const Setting &setting = SETTINGS[static_cast<int>(mode)];
+#if CONFIG_PM_ENABLE
+    esp_pm_config_esp32c3_t config = {};
+    config.max_freq_mhz = setting.maxFrequency_MHz;
+    config.min_freq_mhz = setting.minFrequency_MHz;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    config.light_sleep_enable = setting.lightSleep;
+#endif
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Can't configure power management: %s", esp_err_to_name(err));
+        return;
+    }
+#else
+    // Without power management, the APB clock follows the CPU below 80MHz, which would change the ADC sample rate and the I2C clock.
+    uint16_t frequency_MHz = setting.maxFrequency_MHz < 80 ? 80 : setting.maxFrequency_MHz;
+    if (!setCpuFrequencyMhz(frequency_MHz))
+    {
+        ESP_LOGE(TAG, "Can't set CPU frequency to %u MHz", frequency_MHz);
+        return;
+    }
+#endif
+    ESP_LOGI(TAG, "Mode %d: %u..%u MHz", static_cast<int>(mode), setting.minFrequency_MHz, setting.maxFrequency_MHz);
+}
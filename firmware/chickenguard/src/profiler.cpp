@@ -0,0 +1,129 @@
+#include "profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+static const char *TAG = "Profiler";
+static const char *SECTION_NAMES[] = {"motor run", "RTC poll", "button sample", "battery check", "webserver loop", "event handlers"};
+static_assert(sizeof(SECTION_NAMES) / sizeof(SECTION_NAMES[0]) == static_cast<size_t>(Profiler::Section::Count),
+              "A name is needed for each section");
+
+Profiler::Statistics Profiler::_statistics[static_cast<size_t>(Section::Count)];
+uint32_t Profiler::_overhead = 0;
+uint32_t Profiler::_cost = 0;
+
+/**
+ * @brief Measure the cycles of an empty section, so they can be subtracted from the measurements, and the cost of a recorded
+ * section, to report the overhead of the profiler.  Call once at startup.
+ */
+void Profiler::calibrate()
+{
+    const int RUNS = 64;
+    uint32_t start = cpu_hal_get_cycle_count();
+    for (int i = 0; i < RUNS; i++)
+    {
+        uint32_t sectionStart = cpu_hal_get_cycle_count();
+        (void)(cpu_hal_get_cycle_count() - sectionStart);
+    }
+    _overhead = (cpu_hal_get_cycle_count() - start) / RUNS;
+    start = cpu_hal_get_cycle_count();
+    for (int i = 0; i < RUNS; i++)
+    {
+        PROFILE_SECTION(MotorRun);
+    }
+    _cost = (cpu_hal_get_cycle_count() - start) / RUNS;
+    reset();
+    ESP_LOGI(TAG, "Overhead: %lu cycles subtracted per section, %lu cycles added per execution", _overhead, _cost);
+}
+
+void Profiler::record(Section section, uint32_t cycles)
+{
+    Statistics &statistics = _statistics[static_cast<size_t>(section)];
+    cycles = cycles > _overhead ? cycles - _overhead : 0;
+    if (statistics.count == 0 || cycles < statistics.minCycles)
+    {
+        statistics.minCycles = cycles;
+    }
+    if (cycles > statistics.maxCycles)
+    {
+        statistics.maxCycles = cycles;
+    }
+    statistics.sumCycles += cycles;
+    statistics.count++;
+    // floor(log2(cycles)), 0 cycles counts as 1 cycle
+    size_t bucket = cycles == 0 ? 0 : 31 - __builtin_clz(cycles);
+    if (bucket >= HISTOGRAM_BUCKETS)
+    {
+        bucket = HISTOGRAM_BUCKETS - 1;
+    }
+    if (statistics.histogram[bucket] < UINT16_MAX)
+    {
+        statistics.histogram[bucket]++;
+    }
+}
+
+/**
+ * @brief Print the statistics of all sections that have been executed
+ */
+void Profiler::dump(Print &output)
+{
+    uint32_t frequency_MHz = getCpuFrequencyMhz();
+    output.print("Section           count    min[us]  avg[us]  max[us] overhead  log2(cycles) histogram\r\n");
+    for (size_t i = 0; i < static_cast<size_t>(Section::Count); i++)
+    {
+        const Statistics &statistics = _statistics[i];
+        if (statistics.count == 0)
+        {
+            continue;
+        }
+        uint32_t averageCycles = statistics.sumCycles / statistics.count;
+        output.printf("%-16s %6lu %9lu %8lu %8lu ", SECTION_NAMES[i], statistics.count, statistics.minCycles / frequency_MHz,
+                      averageCycles / frequency_MHz, statistics.maxCycles / frequency_MHz);
+        // Share of the profiler in the section time, in 0.1%
+        uint32_t overhead = _cost == 0 ? 0 : (uint64_t)_cost * 1000 / (averageCycles + _cost);
+        output.printf(" %4lu.%lu%% ", overhead / 10, overhead % 10);
+        for (size_t j = 0; j < HISTOGRAM_BUCKETS; j++)
+        {
+            if (statistics.histogram[j] != 0)
+            {
+                output.printf(" %u:%u", j, statistics.histogram[j]);
+            }
+        }
+        output.printf("\r\n");
+    }
+}
+
+/**
+ * @brief Serialize the statistics into a binary frame for the web clients
+ *
+ * @return size of the frame, 0 when the buffer is too small
+ */
+size_t Profiler::getFrame(uint8_t *frame, size_t size)
+{
+    if (size < MAX_FRAME_SIZE)
+    {
+        return 0;
+    }
+    size_t length = 0;
+    frame[length++] = FRAME_TYPE_PROFILE;
+    frame[length++] = FRAME_VERSION;
+    frame[length++] = static_cast<uint8_t>(Section::Count);
+    frame[length++] = getCpuFrequencyMhz();
+    for (size_t i = 0; i < static_cast<size_t>(Section::Count); i++)
+    {
+        const Statistics &statistics = _statistics[i];
+        uint32_t values[4] = {statistics.count, statistics.minCycles,
+                              statistics.count ? (uint32_t)(statistics.sumCycles / statistics.count) : 0, statistics.maxCycles};
+        memcpy(&frame[length], values, sizeof(values));
+        length += sizeof(values);
+        memcpy(&frame[length], statistics.histogram, sizeof(statistics.histogram));
+        length += sizeof(statistics.histogram);
+    }
+    return length;
+}
+
+void Profiler::reset()
+{
+    memset(_statistics, 0, sizeof(_statistics));
+}
+
+#endif
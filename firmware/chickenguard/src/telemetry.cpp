@@ -0,0 +1,55 @@
+#include "telemetry.h"
+
+Telemetry::Telemetry()
+{
+    clearFrame();
+}
+
+Telemetry::~Telemetry()
+{
+}
+
+/**
+ * @brief Start a new motor run : sample time restarts from 0
+ */
+void Telemetry::start()
+{
+    _startTime = millis();
+    clearFrame();
+}
+
+/**
+ * @brief Add a sample to the frame
+ *
+ * @return true when the frame is full and should be sent
+ */
+bool Telemetry::addSample(uint16_t rawCurrent, uint16_t current, uint16_t voltage_mV, uint8_t state)
+{
+    if (_frame.header.sampleCount >= SAMPLES_PER_FRAME)
+    {
+        // Previous frame has not been sent, drop its oldest sample
+        memmove(&_frame.samples[0], &_frame.samples[1], sizeof(Sample) * (SAMPLES_PER_FRAME - 1));
+        _frame.header.sampleCount--;
+    }
+    Sample &sample = _frame.samples[_frame.header.sampleCount++];
+    sample.time_ms = millis() - _startTime;
+    sample.rawCurrent = rawCurrent;
+    sample.current = current;
+    sample.voltage_mV = voltage_mV;
+    sample.state = state;
+    sample.reserved = 0;
+    return _frame.header.sampleCount == SAMPLES_PER_FRAME;
+}
+
+size_t Telemetry::getFrameSize() const
+{
+    return sizeof(Header) + _frame.header.sampleCount * sizeof(Sample);
+}
+
+void Telemetry::clearFrame()
+{
+    _frame.header.type = FRAME_TYPE_MOTOR;
+    _frame.header.version = FRAME_VERSION;
+    _frame.header.sampleCount = 0;
+    _frame.header.reserved = 0;
+}
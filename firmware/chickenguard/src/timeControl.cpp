@@ -44,12 +44,13 @@ TimeControl::~TimeControl()
 /**
  * @brief Initialize the time control
  *
- * @param timeZone
+ * @param getTimeZone returns the name of the time zone.  Only called at the first local time conversion, see useLocalTime().
  * @return true when RTC could be initialized
  * @return false when RTC could not be initialized
  */
-bool TimeControl::init(String timeZone)
+bool TimeControl::init(const char *(*getTimeZone)())
 {
+    _getTimeZone = getTimeZone;
     assert(detectI2cDevice(_rtc.getI2cAddress()));
     if (_rtc.isTimeValid())
     {
@@ -65,13 +66,6 @@ bool TimeControl::init(String timeZone)
         char strftime_buf[64];
         strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeinfo);
         ESP_LOGI(TAG, "The current UTC date/time is: %s", strftime_buf);
-
-        // set timezone
-        if (setTimeZone(timeZone))
-        {
-            _timeZoneSet = true;
-            printLocalTime();
-        }
     }
     return _rtc.enableSquareWave(false); // disable square wave output to save power
 }
@@ -98,17 +92,50 @@ bool TimeControl::closeDoorAlarmTriggered()
     return false;
 }
 
+/**
+ * @brief The RTC keeps UTC : the time zone isn't needed for a valid time, see useLocalTime().
+ */
 bool TimeControl::hasValidTime()
 {
-    return _rtc.isTimeValid() && _timeZoneSet;
+    return _rtc.isTimeValid();
+}
+
+/**
+ * @brief Set TZ before the first conversion to local time
+ * @details The time zone is only read from the settings when it's needed : by the fixed time mode and the web configuration.
+ * An alarm wake-up in sunrise/sunset mode doesn't need it.
+ * @return true when the time zone is known
+ */
+bool TimeControl::useLocalTime()
+{
+    if (!_timeZoneSet && _getTimeZone != nullptr)
+    {
+        const char *timeZone = _getTimeZone();
+        if (!setTimeZone(timeZone))
+        {
+            ESP_LOGE(TAG, "Unknown time zone: %s", timeZone);
+        }
+    }
+    return _timeZoneSet;
+}
+
+/**
+ * @brief Read the time from the RTC, bypassing the MCU clock
+ *
+ * @param timeinfo UTC
+ * @return true when the RTC could be read and has a valid time
+ */
+bool TimeControl::getRtcTime(tm *timeinfo)
+{
+    return _rtc.isTimeValid() && _rtc.getTime(timeinfo);
 }
 
-bool TimeControl::updateMcuTime(long utc, const String timeZone)
+bool TimeControl::updateMcuTime(long utc, const char *timeZone)
 {
     ESP_LOGI(TAG, "UTC : %lu", utc);
     timeval epoch = {utc, 0};
     settimeofday((const timeval *)&epoch, 0);
-    ESP_LOGI(TAG, "TimeZone : %s", timeZone.c_str());
+    ESP_LOGI(TAG, "TimeZone : %s", timeZone);
 
     tm *timeinfo = gmtime(&utc);
     if (!_rtc.setTime(timeinfo))
@@ -127,11 +154,15 @@ bool TimeControl::updateMcuTime(long utc, const String timeZone)
  * @return true when time zone is set
  * @return false when time zone is not in the list of time zones
  */
-bool TimeControl::setTimeZone(String timeZone)
+bool TimeControl::setTimeZone(const char *timeZone)
 {
+    if (timeZone == nullptr)
+    {
+        return _timeZoneSet;
+    }
     for (int i = 0; i < sizeof(timeZones) / sizeof(timeZone_t); i++)
     {
-        if (timeZone == timeZones[i].name)
+        if (strcmp(timeZone, timeZones[i].name) == 0)
         {
             setenv("TZ", timeZones[i].tz, 1);
             tzset();
@@ -182,7 +213,7 @@ bool TimeControl::setCloseAlarmSunset(double latitude, double longitude)
 
 bool TimeControl::setOpenAlarmFixTime(uint8_t hour, uint8_t minute)
 {
-    if (!hasValidTime())
+    if (!hasValidTime() || !useLocalTime())
     {
         ESP_LOGE(TAG, "Time is not set");
         return false;
@@ -193,7 +224,7 @@ bool TimeControl::setOpenAlarmFixTime(uint8_t hour, uint8_t minute)
 
 bool TimeControl::setCloseAlarmFixTime(uint8_t hour, uint8_t minute)
 {
-    if (!hasValidTime())
+    if (!hasValidTime() || !useLocalTime())
     {
         ESP_LOGE(TAG, "Time is not set");
         return false;
@@ -202,6 +233,43 @@ bool TimeControl::setCloseAlarmFixTime(uint8_t hour, uint8_t minute)
     return _rtc.setDailyAlarm(DS1337::AlarmType::Alarm2, localToUtcTimeObject(hour, minute));
 }
 
+/**
+ * @brief Convert a local time of today to UTC seconds
+ */
+time_t TimeControl::getLocalTimeToday(uint8_t hour, uint8_t minute)
+{
+    useLocalTime();
+    time_t now;
+    time(&now);
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    timeinfo.tm_hour = hour;
+    timeinfo.tm_min = minute;
+    timeinfo.tm_sec = 0;
+    return mktime(&timeinfo);
+}
+
+/**
+ * @brief Sunrise and sunset of the current UTC day
+ *
+ * @return true when the time is valid
+ */
+bool TimeControl::getSunTimesToday(double latitude, double longitude, time_t &sunrise, time_t &sunset)
+{
+    if (!hasValidTime())
+    {
+        return false;
+    }
+    time_t utc;
+    time(&utc);
+    double transit, sunriseHours, sunsetHours;
+    calcSunriseSunset(utc, latitude, longitude, transit, sunriseHours, sunsetHours);
+    time_t midnight = utc - utc % 86400;
+    sunrise = midnight + static_cast<time_t>(sunriseHours * 3600);
+    sunset = midnight + static_cast<time_t>(sunsetHours * 3600);
+    return true;
+}
+
 void TimeControl::doubleToHrMin(double time, uint8_t *hour, uint8_t *minute)
 {
     int m = int(round(time * 60));
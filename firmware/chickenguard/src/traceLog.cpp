@@ -0,0 +1,76 @@
+#include "traceLog.h"
+
+struct EventDescription
+{
+    const char *module;
+    const char *format; //!< Formats arg0 and arg1, in that order
+};
+
+// Same order as TraceLog::Event
+static const EventDescription EVENTS[] = {
+    {"Motor", "Motor voltage: %u mV"},
+    {"Motor", "Current limit at 4.5V: %u mA, new limit: %lu"},
+    {"Motor", "Current: %u"},
+    {"Motor", "Underload current: %u < %lu"},
+    {"Motor", "Underload condition ended: %u"},
+    {"Motor", "No motor current detected: %u < %lu"},
+    {"Motor", "Overload current detected: %u > %lu"},
+    {"Motor", "Raising underload current detected: %u < %lu"},
+    {"Motor", "Lowering overload current detected: %u > %lu"},
+    {"Web", "Notify: %u bytes to %lu clients"},
+};
+static_assert(sizeof(EVENTS) / sizeof(EVENTS[0]) == static_cast<size_t>(TraceLog::Event::Count),
+              "A description is needed for each event");
+
+TraceLog::Slot TraceLog::_ring[RING_SIZE];
+std::atomic<uint32_t> TraceLog::_writeIndex{0};
+
+/**
+ * @brief Add a record to the ring.  Lock-free, can be called from any task.
+ */
+void TraceLog::record(Event event, uint16_t arg0, uint32_t arg1)
+{
+    uint32_t index = _writeIndex.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = _ring[index & (RING_SIZE - 1)];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record.time_us = micros();
+    slot.record.event = static_cast<uint16_t>(event);
+    slot.record.arg0 = arg0;
+    slot.record.arg1 = arg1;
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Format the records in the ring, oldest first.  Records that are being written during the dump are skipped.
+ *
+ * @param output e.g. Serial
+ * @return size_t number of records written
+ */
+size_t TraceLog::dump(Print &output)
+{
+    size_t count = 0;
+    uint32_t end = _writeIndex.load(std::memory_order_acquire);
+    uint32_t start = end > RING_SIZE ? end - RING_SIZE : 0;
+    for (uint32_t index = start; index != end; index++)
+    {
+        const Slot &slot = _ring[index & (RING_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != index + 1)
+        {
+            continue;
+        }
+        Record record = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != index + 1 || record.event >= static_cast<uint16_t>(Event::Count))
+        {
+            continue;
+        }
+        const EventDescription &description = EVENTS[record.event];
+        output.printf("%10lu.%03lu %s: ", (unsigned long)(record.time_us / 1000), (unsigned long)(record.time_us % 1000),
+                      description.module);
+        output.printf(description.format, record.arg0, (unsigned long)record.arg1);
+        output.println();
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,113 @@
+#include "wsReassembler.h"
+#include <string.h>
+
+/**
+ * @brief Add a piece of a frame
+ *
+ * @param opcode opcode of the frame : text or binary for the first frame of a message, continuation for the next frames
+ * @param final the frame is the last one of the message
+ * @param frameLength length of the frame payload
+ * @param index offset of the piece in the frame payload
+ * @param data the piece, must stay valid until the next call when the message is returned in place
+ * @param len length of the piece
+ * @return Result Complete when the piece ends a message, see getMessage()
+ */
+WsReassembler::Result WsReassembler::feed(uint8_t opcode, bool final, uint64_t frameLength, uint64_t index, uint8_t *data, size_t len)
+{
+    _message = nullptr;
+    _messageLength = 0;
+    if (index == 0)
+    {
+        // Start of a frame
+        if (_frameOpen)
+        {
+            return fail(Result::Malformed);
+        }
+        if (opcode == OPCODE_CONTINUATION)
+        {
+            if (_state == State::Idle)
+            {
+                return fail(Result::Malformed);
+            }
+        }
+        else if (opcode == OPCODE_TEXT || opcode == OPCODE_BINARY)
+        {
+            if (_state != State::Idle)
+            {
+                return fail(Result::Malformed);
+            }
+            _state = State::Receiving;
+            _opcode = opcode;
+            _length = 0;
+        }
+        else
+        {
+            return fail(Result::Malformed);
+        }
+        _finalFrame = final;
+        _frameLength = frameLength;
+    }
+    else if (!_frameOpen || index != _frameOffset || frameLength != _frameLength)
+    {
+        return fail(Result::Malformed);
+    }
+    if (index + len > frameLength)
+    {
+        return fail(Result::Malformed);
+    }
+    _frameOffset = index + len;
+    _frameOpen = _frameOffset < frameLength;
+    bool lastPiece = _finalFrame && !_frameOpen;
+
+    if (_state == State::Receiving && _length == 0 && lastPiece)
+    {
+        // The whole message in one piece
+        _state = State::Idle;
+        _message = data;
+        _messageLength = len;
+        return Result::Complete;
+    }
+    Result result = Result::Incomplete;
+    if (_state == State::Receiving)
+    {
+        if (len > MAX_MESSAGE_SIZE - _length)
+        {
+            _state = State::Discarding;
+            result = Result::TooLarge;
+        }
+        else
+        {
+            memcpy(_buffer + _length, data, len);
+            _length += len;
+        }
+    }
+    if (lastPiece)
+    {
+        if (_state == State::Receiving)
+        {
+            _message = _buffer;
+            _messageLength = _length;
+            result = Result::Complete;
+        }
+        _state = State::Idle;
+    }
+    return result;
+}
+
+/**
+ * @brief Drop the message in progress, e.g. when the client reconnects
+ */
+void WsReassembler::reset()
+{
+    _state = State::Idle;
+    _frameOpen = false;
+    _length = 0;
+    _message = nullptr;
+    _messageLength = 0;
+}
+
+WsReassembler::Result WsReassembler::fail(Result result)
+{
+    reset();
+    return result;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file main.cpp
+ * @brief Counts the String heap allocations and the NVS writes made by NonVolatileStorage during a web configuration.
+ * @details Build and run on the host with tools/alloc-count/run.sh
+ *  The transaction is the sequence of calls made when a web client submits the configuration : the settings from the JSON message
+ *  are stored, saved to NVS and the time zone is read back for the RTC.  The following boots restore the settings.
+ *  The settings of older firmware, stored as separate keys, must be migrated at the first access.  The settings are restored on
+ *  demand : an alarm wake-up in sunrise/sunset mode mustn't read the time zone, one in fixed time mode reads it once.
+ *  The wake-up makes the NonVolatileStorage calls of setup() and handleAlarm() in main.cpp, in the same order.  The time zone is
+ *  only read through the callback given to TimeControl::init(), as TimeControl::useLocalTime() does.
+ */
+#include "NonVolatileStorage.h"
+
+size_t stringAllocations = 0;
+
+static NonVolatileStorage *wakeUpConfig;
+
+// The callback of TimeControl::init()
+static const char *getTimeZone()
+{
+    return wakeUpConfig->getTimeZone();
+}
+
+/**
+ * @brief Boot after an alarm, with the settings stored by the previous boots
+ *
+ * @param expected door control that has been stored
+ * @param localTime the door control needs the time zone
+ * @return true when the settings have been restored and the time zone has only been read when it's needed
+ */
+static bool wakeUp(NonVolatileStorage::DoorControl expected, bool localTime)
+{
+    size_t start = stringAllocations;
+    NonVolatileStorage config;
+    wakeUpConfig = &config;
+    // setup()
+    bool ok = config.begin();
+    config.restoreDoorState();
+    // handleAlarm() : the alarm of the next door run
+    NonVolatileStorage::DoorControl doorControl = config.getDoorControl();
+    uint8_t hour = 0, minutes = 0;
+    float latitude = 0, longitude = 0;
+    switch (doorControl)
+    {
+    case NonVolatileStorage::DoorControl::SunriseSunset:
+        config.getGeoLocation(latitude, longitude);
+        ok = ok && latitude > 50 && latitude < 51;
+        break;
+    case NonVolatileStorage::DoorControl::FixTime:
+        config.getFixClosingTime(hour, minutes);
+        // TimeControl::setCloseAlarmFixTime() needs the local time
+        ok = ok && strcmp(getTimeZone(), "Europe/Brussels") == 0 && hour == 21 && minutes == 45;
+        break;
+    default:
+        ok = false;
+        break;
+    }
+    ok = ok && doorControl == expected;
+    bool timeZoneRead = config.getReadTimes().timeZone_us != 0;
+    bool lazy = timeZoneRead == localTime;
+    printf("Alarm wake-up %-9s: %zu String allocations, %s, time zone %s\n",
+           doorControl == NonVolatileStorage::DoorControl::FixTime ? "fix time" : "sun", stringAllocations - start,
+           ok ? "ok" : "FAILED", timeZoneRead ? "read" : "not read");
+    return ok && lazy;
+}
+
+int main()
+{
+    // Settings as stored by the firmware before the config blob
+    Preferences preferences;
+    preferences.begin("door", false);
+    preferences.putBool("nvsInit", true);
+    preferences.putUChar("doorControl", 1);
+    preferences.putUChar("open_hour", 6);
+    preferences.putString("timeZone", "Europe/Brussels");
+    preferences.end();
+
+    NonVolatileStorage config;
+    config.begin();
+    uint8_t hour, minutes;
+    config.getFixOpeningTime(hour, minutes);
+    preferences.begin("door", true);
+    bool migrated = config.getDoorControl() == NonVolatileStorage::DoorControl::FixTime && hour == 6 &&
+                    strcmp(config.getTimeZone(), "Europe/Brussels") == 0 && !preferences.isKey("nvsInit") &&
+                    preferences.isKey("config");
+    preferences.end();
+    printf("Migration         : %s, %lu NVS writes\n", migrated ? "ok" : "FAILED", (unsigned long)config.getWriteCount());
+
+    size_t start = stringAllocations;
+    uint32_t writes = config.getWriteCount();
+    // The webserver parses the message, the scheduler applies the copy
+    NonVolatileStorage::DoorControl doorControl = NonVolatileStorage::DoorControl::Manual;
+    uint8_t openHour = 0, openMinute = 0, closeHour = 0, closeMinute = 0;
+    NonVolatileStorage::parseDoorControl("fixedTime", doorControl);
+    NonVolatileStorage::parseTimeString("07:30", openHour, openMinute);
+    NonVolatileStorage::parseTimeString("21:45", closeHour, closeMinute);
+    config.setGeoLocation(50.85, 4.35);
+    config.setDoorControl(doorControl);
+    config.setFixOpeningTime(openHour, openMinute);
+    config.setFixClosingTime(closeHour, closeMinute);
+    config.setTimeZone("Europe/Brussels");
+    config.saveAll();
+    const char *timeZone = config.getTimeZone();
+    (void)timeZone;
+    printf("Web configuration : %zu String allocations, %lu NVS writes\n", stringAllocations - start,
+           (unsigned long)(config.getWriteCount() - writes));
+
+    // The same settings submitted again
+    writes = config.getWriteCount();
+    config.saveAll();
+    printf("Unchanged save    : %lu NVS writes\n", (unsigned long)(config.getWriteCount() - writes));
+
+    bool fixTimeLazy = wakeUp(NonVolatileStorage::DoorControl::FixTime, true);
+
+    // Switch to sunrise/sunset
+    config.setDoorControl(NonVolatileStorage::DoorControl::SunriseSunset);
+    config.saveAll();
+    bool sunLazy = wakeUp(NonVolatileStorage::DoorControl::SunriseSunset, false);
+    return migrated && fixTimeLazy && sunLazy ? 0 : 1;
+}
@@ -0,0 +1,8 @@
+#!/bin/sh
+# Build the allocation counter for the host and run it.
+set -e
+cd "$(dirname "$0")/../.."
+mkdir -p .pio/alloc-count
+g++ -std=gnu++17 -O2 -Wall -Itools/alloc-count/stubs -Iinclude tools/alloc-count/main.cpp src/NonVolatileStorage.cpp \
+    -o .pio/alloc-count/alloc-count
+.pio/alloc-count/alloc-count
@@ -0,0 +1,103 @@
+/**
+ * @brief Minimal Arduino API for the allocation counter.
+ * @details String stores short strings inline, like the ESP32 core (WString.h, SSOSIZE = 15 bytes including the terminator), and
+ * counts every heap allocation it makes in stringAllocations.
+ */
+#pragma once
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+
+extern size_t stringAllocations;
+
+// Advances at every call, so the read times of the settings that have been read aren't 0
+inline unsigned long micros()
+{
+    static unsigned long now = 0;
+    return now += 10;
+}
+
+// newlib has strlcpy, glibc only since 2.38
+inline size_t strlcpy(char *destination, const char *source, size_t size)
+{
+    size_t length = strlen(source);
+    if (size > 0)
+    {
+        size_t count = length < size - 1 ? length : size - 1;
+        memcpy(destination, source, count);
+        destination[count] = '\0';
+    }
+    return length;
+}
+
+class String
+{
+public:
+    String(const char *text = "") { assign(text ? text : "", text ? strlen(text) : 0); }
+    String(const String &other) { assign(other.c_str(), other._length); }
+    ~String() { release(); }
+    String &operator=(const String &other)
+    {
+        if (this != &other)
+        {
+            release();
+            assign(other.c_str(), other._length);
+        }
+        return *this;
+    }
+    String &operator=(const char *text)
+    {
+        release();
+        assign(text ? text : "", text ? strlen(text) : 0);
+        return *this;
+    }
+    const char *c_str() const { return _heap ? _heap : _inline; }
+    unsigned int length() const { return _length; }
+    bool equals(const char *text) const { return strcmp(c_str(), text) == 0; }
+    bool operator==(const char *text) const { return equals(text); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        char buffer[256] = {};
+        if (to > _length)
+        {
+            to = _length;
+        }
+        if (from < to)
+        {
+            memcpy(buffer, c_str() + from, to - from);
+        }
+        return String(buffer);
+    }
+    long toInt() const { return atol(c_str()); }
+
+private:
+    static const size_t SSO_SIZE = 15;
+    void assign(const char *text, size_t length)
+    {
+        _length = length;
+        if (length < SSO_SIZE)
+        {
+            _heap = nullptr;
+            memcpy(_inline, text, length + 1);
+        }
+        else
+        {
+            stringAllocations++;
+            _heap = static_cast<char *>(malloc(length + 1));
+            memcpy(_heap, text, length + 1);
+        }
+    }
+    void release()
+    {
+        free(_heap);
+        _heap = nullptr;
+    }
+    char _inline[SSO_SIZE];
+    char *_heap = nullptr;
+    size_t _length = 0;
+};
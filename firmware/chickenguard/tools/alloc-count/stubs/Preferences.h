@@ -0,0 +1,77 @@
+/**
+ * @brief In-memory replacement of the ESP32 Preferences (NVS) library, with the String API of the real one.
+ * @details Only the String objects are counted : the storage itself stands for NVS.
+ */
+#pragma once
+
+#include "Arduino.h"
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false)
+    {
+        _namespace = name;
+        return true;
+    }
+    void end() {}
+    bool isKey(const char *key) { return storage().count(path(key)) != 0; }
+    bool remove(const char *key) { return storage().erase(path(key)) != 0; }
+    size_t getBytesLength(const char *key)
+    {
+        auto it = storage().find(path(key));
+        return it == storage().end() ? 0 : it->second.size();
+    }
+    size_t getBytes(const char *key, void *buf, size_t maxLen)
+    {
+        auto it = storage().find(path(key));
+        if (it == storage().end() || it->second.size() > maxLen)
+        {
+            return 0;
+        }
+        memcpy(buf, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+    size_t putBytes(const char *key, const void *value, size_t len)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(value);
+        storage()[path(key)].assign(bytes, bytes + len);
+        return len;
+    }
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putUChar(const char *key, uint8_t value) { return putBytes(key, &value, sizeof(value)); }
+    bool getBool(const char *key, bool defaultValue = false) { return get(key, defaultValue); }
+    size_t putBool(const char *key, bool value) { return putBytes(key, &value, sizeof(value)); }
+    float getFloat(const char *key, float defaultValue = 0) { return get(key, defaultValue); }
+    size_t putFloat(const char *key, float value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putString(const char *key, const char *value) { return putBytes(key, value, strlen(value) + 1); }
+    size_t putString(const char *key, String value) { return putString(key, value.c_str()); }
+    size_t getString(const char *key, char *value, size_t maxLen)
+    {
+        size_t length = getBytes(key, value, maxLen);
+        return length;
+    }
+    String getString(const char *key, String defaultValue = String())
+    {
+        char value[256];
+        return getString(key, value, sizeof(value)) ? String(value) : defaultValue;
+    }
+
+private:
+    template <typename T>
+    T get(const char *key, T defaultValue)
+    {
+        T value;
+        return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+    }
+    std::string path(const char *key) const { return _namespace + "/" + key; }
+    static std::map<std::string, std::vector<uint8_t>> &storage()
+    {
+        static std::map<std::string, std::vector<uint8_t>> nvs;
+        return nvs;
+    }
+    std::string _namespace;
+};
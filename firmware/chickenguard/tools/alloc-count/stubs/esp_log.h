@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdio.h>
+
+// Logging isn't counted : on the target, ESP_LOGx formats on the stack.
+#define ALLOC_COUNT_LOG(tag, format, ...)        \
+    do                                           \
+    {                                            \
+        (void)(tag);                             \
+        if (0)                                   \
+            printf(format, ##__VA_ARGS__);       \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ALLOC_COUNT_LOG(tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ALLOC_COUNT_LOG(tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ALLOC_COUNT_LOG(tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ALLOC_COUNT_LOG(tag, format, ##__VA_ARGS__)
@@ -0,0 +1,9 @@
+/**
+ * @brief Minimal FreeRTOS types for the allocation counter, which runs in a single thread.
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
@@ -0,0 +1,38 @@
+/**
+ * @brief Mutex of the allocation counter : there's only one thread, so taking it always succeeds.
+ */
+#pragma once
+
+#include "FreeRTOS.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct StaticSemaphore_t
+{
+    int count;
+};
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+    buffer->count = 1;
+    return buffer;
+}
+
+inline bool xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+    // A task taking a mutex it already holds would deadlock on the target
+    if (semaphore->count == 0)
+    {
+        fprintf(stderr, "Mutex already taken\n");
+        abort();
+    }
+    semaphore->count--;
+    return true;
+}
+
+inline bool xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    semaphore->count++;
+    return true;
+}
@@ -0,0 +1,79 @@
+"""
+PlatformIO pre-script : bundle the web UI of data/ into a single gzipped page, compiled into the firmware.
+
+index.css and index.js are inlined in index.html, so a page load is a single request.  Comments and indentation are stripped, then
+the page is gzipped and written as a constexpr byte array to .pio/generated/webUi.h, see Webservice.cpp.  The gzip output is
+reproducible (no file name or time in the header), so the ETag, a hash of the gzipped page, only changes when the UI changes.
+The header is only rewritten when its content changes, to avoid needless rebuilds.
+"""
+import gzip
+import hashlib
+import os
+import re
+
+Import("env")  # noqa: F821
+
+PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+SOURCE_DIR = os.path.join(PROJECT_DIR, "data")
+OUTPUT_DIR = os.path.join(PROJECT_DIR, ".pio", "generated")
+OUTPUT_FILE = os.path.join(OUTPUT_DIR, "webUi.h")
+
+
+def read(name):
+    with open(os.path.join(SOURCE_DIR, name), "r", encoding="utf-8") as f:
+        return f.read()
+
+
+def strip_lines(text, line_comment=None):
+    """Remove the indentation, empty lines and full-line comments.  Code within a line is left alone."""
+    lines = []
+    in_block_comment = False
+    for line in text.splitlines():
+        line = line.strip()
+        if in_block_comment:
+            in_block_comment = "*/" not in line
+            continue
+        if line.startswith("/*"):
+            in_block_comment = "*/" not in line
+            continue
+        if not line or (line_comment and line.startswith(line_comment)):
+            continue
+        lines.append(line)
+    return "\n".join(lines)
+
+
+def bundle():
+    html = re.sub(r"<!--.*?-->", "", read("index.html"), flags=re.S)
+    css = strip_lines(read("index.css"))
+    js = strip_lines(read("index.js"), "//")
+    assert "</script" not in js and "</style" not in css
+    for old, new in (('<link rel="stylesheet" href="index.css">', "<style>%s</style>" % css),
+                     ('<script src="index.js"></script>', "<script>%s</script>" % js)):
+        assert old in html, old
+        html = html.replace(old, new)
+    return strip_lines(html).encode("utf-8")
+
+
+def to_header(page, content):
+    etag = hashlib.sha256(content).hexdigest()[:16]
+    rows = [", ".join("0x%02x" % b for b in content[i:i + 16]) for i in range(0, len(content), 16)]
+    return ("// Generated by tools/compress_web.py from data/, do not edit\n"
+            "#pragma once\n"
+            "#include <stddef.h>\n"
+            "#include <stdint.h>\n\n"
+            "namespace WebUi\n"
+            "{\n"
+            "constexpr size_t PAGE_SIZE = %u; // %u bytes before compression\n"
+            "constexpr char ETAG[] = \"\\\"%s\\\"\";\n"
+            "constexpr uint8_t PAGE[] = {\n    %s};\n"
+            "} // namespace WebUi\n") % (len(content), len(page), etag, ",\n    ".join(rows))
+
+
+page = bundle()
+header = to_header(page, gzip.compress(page, compresslevel=9, mtime=0))
+os.makedirs(OUTPUT_DIR, exist_ok=True)
+if not os.path.exists(OUTPUT_FILE) or open(OUTPUT_FILE, "r").read() != header:
+    with open(OUTPUT_FILE, "w") as f:
+        f.write(header)
+    print("compress_web: %s updated" % OUTPUT_FILE)
+env.Append(CPPPATH=[OUTPUT_DIR])  # noqa: F821
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""
+Convert the motor traces downloaded from http://4.3.2.1/trace to CSV.
+
+Usage : decode_trace.py trace.bin > trace.csv
+
+The format is documented in include/motorTrace.h.
+"""
+import struct
+import sys
+import time
+
+HEADER = struct.Struct("<HBBIHHB3x")
+TRACE_MAGIC = 0x5254
+FLAG_TRUNCATED = 0x01
+
+DIRECTIONS = ["raise", "lower"]
+# Must match MotorControl::MotorState
+STATES = ["Off", "start_raise", "start_lower", "dead_time", "raising_under_load", "running"]
+# Must match MotorControl::StopReason
+STOP_REASONS = ["None", "EndPosition", "Overload", "Timeout", "NoCurrent"]
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def name(table, index):
+    return table[index] if index < len(table) else str(index)
+
+
+def decode(data):
+    pos = 0
+    run = 0
+    while pos + HEADER.size <= len(data):
+        magic, version, direction, utc, voltage, length, flags = HEADER.unpack_from(data, pos)
+        if magic != TRACE_MAGIC or version != 1:
+            raise ValueError(f"Invalid trace header at offset {pos}")
+        pos += HEADER.size
+        end = pos + length
+        start = time.strftime("%Y-%m-%dT%H:%M:%SZ", time.gmtime(utc))
+        if flags & FLAG_TRUNCATED:
+            print(f"Run {run} is truncated", file=sys.stderr)
+        t = 0
+        sample = 0
+        state = ""
+        while pos < end:
+            header, pos = read_varint(data, pos)
+            delta_t, pos = read_varint(data, pos)
+            t += delta_t
+            if header & 1 == 0:
+                zigzag = header >> 1
+                sample += (zigzag >> 1) ^ -(zigzag & 1)
+                yield run, start, name(DIRECTIONS, direction), voltage, t, sample, state, ""
+            else:
+                value, pos = read_varint(data, pos)
+                if header >> 1 == 0:
+                    state = name(STATES, value)
+                    yield run, start, name(DIRECTIONS, direction), voltage, t, "", state, ""
+                else:
+                    yield run, start, name(DIRECTIONS, direction), voltage, t, "", state, name(STOP_REASONS, value)
+        run += 1
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    print("run,start_utc,direction,motor_voltage_mV,time_ms,adc,state,stop_reason")
+    for row in decode(data):
+        print(",".join(str(field) for field in row))
+
+
+if __name__ == "__main__":
+    main()
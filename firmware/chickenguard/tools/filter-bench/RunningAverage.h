@@ -0,0 +1,46 @@
+/**
+ * @brief Same algorithm as robtillaart/RunningAverage 0.4.x : float buffer, getAverage() sums the whole buffer.
+ */
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+class RunningAverage
+{
+public:
+    explicit RunningAverage(uint16_t size) : _values(size) {}
+    void clear()
+    {
+        _count = 0;
+        _index = 0;
+    }
+    void addValue(float value)
+    {
+        _values[_index] = value;
+        _index = (_index + 1) % _values.size();
+        if (_count < _values.size())
+        {
+            _count++;
+        }
+    }
+    float getAverage() const
+    {
+        if (_count == 0)
+        {
+            return NAN;
+        }
+        float sum = 0;
+        for (uint16_t i = 0; i < _count; i++)
+        {
+            sum += _values[i];
+        }
+        return sum / _count;
+    }
+
+private:
+    std::vector<float> _values;
+    uint16_t _count = 0;
+    uint16_t _index = 0;
+};
@@ -0,0 +1,77 @@
+/**
+ * @file main.cpp
+ * @brief Compares the cost of the filters in include/filters.h with RunningAverage, as used before by MotorControl.
+ * @details Build and run on the host with tools/filter-bench/run.sh
+ *  Every iteration adds a sample and reads the filter output, like MotorControl::readAdc() does.
+ *  The host has an FPU, so the difference with RunningAverage is smaller than on the ESP32-C3, where float math is done in software.
+ */
+#include "filters.h"
+#include "RunningAverage.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+static const size_t WINDOW = 20;
+static const size_t ITERATIONS = 2000000;
+
+static std::vector<uint16_t> createSamples()
+{
+    std::mt19937 random(1);
+    std::normal_distribution<float> noise(1300, 40);
+    std::vector<uint16_t> samples(4096);
+    for (uint16_t &sample : samples)
+    {
+        sample = static_cast<uint16_t>(noise(random));
+    }
+    return samples;
+}
+
+template <typename Filter, typename Output>
+static void benchmark(const char *name, Filter &filter, const std::vector<uint16_t> &samples, Output output)
+{
+    volatile uint32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ITERATIONS; i++)
+    {
+        filter.add(samples[i % samples.size()]);
+        sink = sink + output(filter);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(stop - start).count() / ITERATIONS;
+    printf("%-32s %8.1f ns/sample\n", name, ns);
+}
+
+/**
+ * @brief Gives RunningAverage the same interface as the filters
+ */
+class RunningAverageAdapter : public RunningAverage
+{
+public:
+    RunningAverageAdapter() : RunningAverage(WINDOW) {}
+    void add(uint16_t value) { addValue(value); }
+};
+
+int main()
+{
+    std::vector<uint16_t> samples = createSamples();
+
+    RunningAverageAdapter runningAverage;
+    benchmark("RunningAverage(20)", runningAverage, samples, [](RunningAverageAdapter &f) { return (uint32_t)f.getAverage(); });
+
+    MovingAverage<uint16_t, WINDOW> movingAverage;
+    benchmark("MovingAverage<uint16_t, 20>", movingAverage, samples, [](MovingAverage<uint16_t, WINDOW> &f) { return f.get(); });
+
+    MedianFilter<uint16_t, 3> median3;
+    benchmark("MedianFilter<uint16_t, 3>", median3, samples, [](MedianFilter<uint16_t, 3> &f) { return f.get(); });
+
+    MedianFilter<uint16_t, 9> median9;
+    benchmark("MedianFilter<uint16_t, 9>", median9, samples, [](MedianFilter<uint16_t, 9> &f) { return f.get(); });
+
+    Ewma<uint16_t, 3> ewma;
+    benchmark("Ewma<uint16_t, 3>", ewma, samples, [](Ewma<uint16_t, 3> &f) { return f.get(); });
+
+    MinMaxFilter<uint16_t, WINDOW> minMax;
+    benchmark("MinMaxFilter<uint16_t, 20>", minMax, samples, [](MinMaxFilter<uint16_t, WINDOW> &f) { return f.getMax(); });
+    return 0;
+}
@@ -0,0 +1,7 @@
+#!/bin/sh
+# Build the filter benchmark for the host and run it.
+set -e
+cd "$(dirname "$0")/../.."
+mkdir -p .pio/filter-bench
+g++ -std=gnu++17 -O2 -Wall -Iinclude -Itools/filter-bench tools/filter-bench/main.cpp -o .pio/filter-bench/filter-bench
+.pio/filter-bench/filter-bench
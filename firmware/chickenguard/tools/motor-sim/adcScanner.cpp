@@ -0,0 +1,107 @@
+/**
+ * @file adcScanner.cpp
+ * @brief AdcScanner on the simulation clock, replaces src/adcScanner.cpp in the host build.
+ * @details There's no DMA scan : when a consumer reads a channel and a period has elapsed, the mean of a burst of analogRead() calls
+ * is published.  The plant adds independent noise to each call, so this averages the noise like the scan does, but the plant is only
+ * observed at the time of the read.
+ */
+#include "adcScanner.h"
+
+static const uint32_t SAMPLE_FREQUENCY = 3000; //!< Same as the firmware
+
+AdcScanner::AdcScanner()
+{
+}
+
+AdcScanner::~AdcScanner()
+{
+}
+
+bool AdcScanner::addChannel(uint8_t pin, uint16_t period_ms, uint16_t maxValid_mV)
+{
+    // No calibration curve on the host, maxValid_mV isn't applied
+    (void)maxValid_mV;
+    if (_running || _channelCount >= MAX_CHANNELS || period_ms == 0)
+    {
+        return false;
+    }
+    Channel &channel = _channels[_channelCount++];
+    channel.pin = pin;
+    channel.adcChannel = pin;
+    channel.period_ms = period_ms;
+    channel.sampleCount = 0;
+    channel.sum = 0;
+    channel.reading = {};
+    return true;
+}
+
+bool AdcScanner::begin()
+{
+    if (_running || _channelCount == 0)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < _channelCount; i++)
+    {
+        Channel &channel = _channels[i];
+        channel.samplesPerPeriod = max(1UL, (unsigned long)channel.period_ms * SAMPLE_FREQUENCY / (1000 * _channelCount));
+        // Periods are counted from the start of the scan
+        channel.sampleCount = millis() / channel.period_ms;
+    }
+    _running = true;
+    return true;
+}
+
+bool AdcScanner::getReading(uint8_t pin, Reading &reading)
+{
+    Channel *channel = findChannel(pin);
+    if (channel == nullptr || !_running)
+    {
+        return false;
+    }
+    uint32_t period = millis() / channel->period_ms;
+    if (period != channel->sampleCount)
+    {
+        channel->sampleCount = period;
+        uint32_t sum = 0;
+        uint16_t raw = 0;
+        for (uint32_t i = 0; i < channel->samplesPerPeriod; i++)
+        {
+            raw = analogRead(pin);
+            sum += raw;
+        }
+        channel->reading.raw = raw;
+        channel->reading.mV = raw * 2500 / 4095;
+        channel->reading.filteredRaw = (sum + channel->samplesPerPeriod / 2) / channel->samplesPerPeriod;
+        channel->reading.filtered_mV = channel->reading.filteredRaw * 2500 / 4095;
+        channel->reading.count++;
+        channel->slot.write(channel->reading);
+    }
+    return channel->slot.read(reading) && reading.count > 0;
+}
+
+bool AdcScanner::waitForReading(uint8_t pin, Reading &reading, uint32_t timeout_ms)
+{
+    unsigned long startTime = millis();
+    while (!getReading(pin, reading))
+    {
+        if (millis() - startTime > timeout_ms)
+        {
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+AdcScanner::Channel *AdcScanner::findChannel(uint8_t pin)
+{
+    for (size_t i = 0; i < _channelCount; i++)
+    {
+        if (_channels[i].pin == pin)
+        {
+            return &_channels[i];
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,123 @@
+#include "doorPlant.h"
+#include <math.h>
+#include <algorithm>
+
+DoorPlant::DoorPlant(const Parameters &parameters, uint32_t seed) : _parameters(parameters),
+                                                                    _random(seed),
+                                                                    _noise(0, parameters.noise)
+{
+    _position = parameters.startPosition;
+    _ropeToWind = parameters.looseRope_ms;
+}
+
+void DoorPlant::setPins(bool in1, bool in2)
+{
+    if (_in1 == in1 && _in2 == in2)
+    {
+        return;
+    }
+    _in1 = in1;
+    _in2 = in2;
+    _sinceStart = 0;
+    if (_position < 0)
+    {
+        // Door starts at the opposite end of the requested move
+        _position = (in2 && !in1) ? 0 : 1;
+    }
+}
+
+float DoorPlant::getMotorVoltage_mV() const
+{
+    return _parameters.batteryVoltage_mV - _current * _parameters.sourceResistance_mOhm * 1e-3f;
+}
+
+/**
+ * @brief Advance the simulation
+ *
+ * @param dt_ms time step
+ * @param now_ms simulation time at the end of the step
+ */
+void DoorPlant::step(unsigned long dt_ms, unsigned long now_ms)
+{
+    float target = targetCurrent(dt_ms, now_ms);
+    // Current (load) scales with the motor voltage, same model as the one used for the limits in the firmware.
+    target *= 1.0f + 0.133f * (getMotorVoltage_mV() - 4500) * 1e-3f;
+    _current += (target - _current) * (1.0f - expf(-(float)dt_ms / _parameters.timeConstant_ms));
+}
+
+float DoorPlant::targetCurrent(unsigned long dt_ms, unsigned long now_ms)
+{
+    if (!isMotorOn())
+    {
+        return 0;
+    }
+    _sinceStart += dt_ms;
+    float inrush = _parameters.inrushCurrent * expf(-_sinceStart / 150.0f);
+    float speed = dt_ms / _parameters.travelTime_ms;
+    bool jammed = _endpoint == Endpoint::Jammed;
+    if (_in2)
+    {
+        // Raising
+        if (_ropeToWind > 0)
+        {
+            _ropeToWind -= dt_ms;
+            return std::max(inrush, _parameters.freeCurrent);
+        }
+        if (jammed || _position >= 1)
+        {
+            return _parameters.stallCurrent;
+        }
+        _position = std::min(1.0f, _position + speed);
+        if (_parameters.jamPosition >= 0 && _position >= _parameters.jamPosition && _position - speed < _parameters.jamPosition)
+        {
+            reachEndpoint(Endpoint::Jammed, now_ms);
+        }
+        else if (_position >= 1)
+        {
+            reachEndpoint(Endpoint::Top, now_ms);
+        }
+        return std::max(inrush, _parameters.liftCurrent);
+    }
+    // Lowering
+    if (jammed)
+    {
+        // Door stuck : the rope goes slack and the motor runs freely
+        _ropeToWind += dt_ms;
+        return std::max(inrush, _parameters.freeCurrent * 0.7f);
+    }
+    if (_position <= 0)
+    {
+        // Rope unwinds until it's straight, then it gets wound up in the other direction.
+        _slackRope += dt_ms;
+        if (_slackRope < _parameters.slackRope_ms)
+        {
+            return _parameters.freeCurrent * 0.7f;
+        }
+        return _parameters.reverseWindCurrent;
+    }
+    _position = std::max(0.0f, _position - speed);
+    if (_parameters.jamPosition >= 0 && _position <= _parameters.jamPosition && _position + speed > _parameters.jamPosition)
+    {
+        reachEndpoint(Endpoint::Jammed, now_ms);
+    }
+    else if (_position <= 0)
+    {
+        reachEndpoint(Endpoint::Bottom, now_ms);
+    }
+    return std::max(inrush, _parameters.lowerCurrent);
+}
+
+void DoorPlant::reachEndpoint(Endpoint endpoint, unsigned long now_ms)
+{
+    if (_endpoint == Endpoint::None)
+    {
+        _endpoint = endpoint;
+        _endpointTime = now_ms;
+    }
+}
+
+uint16_t DoorPlant::readAdc()
+{
+    float value = _parameters.zeroOffset + _current + _noise(_random);
+    return static_cast<uint16_t>(std::min(4095.0f, std::max(0.0f, value)));
+}
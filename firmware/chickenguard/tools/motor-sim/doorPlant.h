@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <random>
+
+/**
+ * @brief Simulated motor, rope and door, as seen by MotorControl through the H-bridge pins and the current sense ADC.
+ * @details Currents are expressed in ADC-counts, which is also the unit of the limits in MotorControl.  The nominal values at 4.5V
+ * come from the measurements in docs/R1.1/measurements.  Current scales with the motor voltage like in MotorControl::limitConversion.
+ */
+class DoorPlant
+{
+public:
+    struct Parameters
+    {
+        float batteryVoltage_mV = 4500;     //!< Open circuit voltage
+        float sourceResistance_mOhm = 300;  //!< Battery internal resistance plus wiring : causes voltage sag under load
+        float zeroOffset = 30;              //!< Output of the current sense amplifier with the motor off
+        float noise = 25;                   //!< Standard deviation of the ADC noise
+        float timeConstant_ms = 80;         //!< Time constant of the current following the load
+        float inrushCurrent = 2600;         //!< Current when the motor starts
+        float freeCurrent = 520;            //!< Winding loose rope, no load
+        float liftCurrent = 1300;           //!< Lifting the door
+        float lowerCurrent = 420;           //!< Letting the door down
+        float stallCurrent = 2400;          //!< Door against the top stop, or jammed
+        float reverseWindCurrent = 1200;    //!< Door down, rope being wound up in the wrong direction
+        float travelTime_ms = 12000;        //!< Time needed to move the door over its full range
+        float looseRope_ms = 0;             //!< Loose rope to be wound up before the door lifts
+        float slackRope_ms = 600;           //!< Rope unwound after the door reached the bottom, before the rope loads the motor again
+        float jamPosition = -1;             //!< Door gets stuck at this position [0..1], negative = no jam
+        float startPosition = -1;           //!< Initial door position [0..1], negative = the opposite end of the requested move
+    };
+    enum class Endpoint
+    {
+        None,
+        Top,
+        Bottom,
+        Jammed
+    };
+
+    DoorPlant(const Parameters &parameters, uint32_t seed);
+    void setPins(bool in1, bool in2);
+    void step(unsigned long dt_ms, unsigned long now_ms);
+    uint16_t readAdc();
+    float getPosition() const { return _position; }
+    Endpoint getEndpoint() const { return _endpoint; }
+    unsigned long getEndpointTime() const { return _endpointTime; }
+    bool isMotorOn() const { return _in1 != _in2; }
+    float getMotorVoltage_mV() const;
+
+private:
+    float targetCurrent(unsigned long dt_ms, unsigned long now_ms);
+    void reachEndpoint(Endpoint endpoint, unsigned long now_ms);
+    Parameters _parameters;
+    std::mt19937 _random;
+    std::normal_distribution<float> _noise;
+    bool _in1 = false;
+    bool _in2 = false;
+    float _current = 0;
+    float _position = 0;
+    float _ropeToWind = 0;    //!< ms of loose rope left before the door moves
+    float _slackRope = 0;     //!< ms of rope unwound since the door hit the bottom
+    float _sinceStart = 0;    //!< ms since the motor was switched on
+    Endpoint _endpoint = Endpoint::None;
+    unsigned long _endpointTime = 0;
+};
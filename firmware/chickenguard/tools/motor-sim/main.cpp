@@ -0,0 +1,273 @@
+/**
+ * @file main.cpp
+ * @brief Runs the MotorControl state machine of the firmware against a simulated door, in virtual time.
+ * @details Build and run on the host with tools/motor-sim/run.sh
+ *  Options :
+ *    -n <count>  : runs per scenario (default 20)
+ *    -l <ms>     : period at which the main loop calls MotorControl::run() (default 10)
+ *    -s <name>   : only run the scenarios whose name contains <name>
+ *    -k          : keep the learned motor statistics between scenarios
+ *    -v          : print the firmware log
+ *  By default, the learned motor statistics are cleared for each scenario.  As a scenario only moves the door in one direction, the
+ *  default limits are used.  With -k, the limits learned in the previous scenarios are used, once both directions have been learned.
+ *  Reported metrics :
+ *    - false stop : the motor stopped before the door reached an end position or got jammed
+ *    - missed     : the door reached an end position, but the motor was only stopped by a timeout
+ *    - latency    : time from the door reaching an end position until the firmware decides to stop the motor
+ *    - overrun    : time from the door reaching an end position until the motor is switched off
+ */
+#include "Arduino.h"
+#include "Preferences.h"
+#include "motorControl.h"
+#include "doorPlant.h"
+#include <string>
+#include <vector>
+
+bool simVerbose = false;
+
+static const uint8_t PIN_IN1 = 6;
+static const uint8_t PIN_IN2 = 7;
+static const uint8_t PIN_BUTTON = 2;
+static const uint8_t PIN_VMOTOR = 3;
+static const uint8_t PIN_CURRENT_SENSE = 4;
+static const unsigned long MAX_RUN_TIME = 120000;
+
+static unsigned long simTime_ms = 0;
+static DoorPlant *plant = nullptr;
+static bool pinIn1 = false;
+static bool pinIn2 = false;
+
+// ----------------------------------------------------------------------------
+// Arduino API on the simulation clock
+// ----------------------------------------------------------------------------
+
+static void advance(unsigned long ms)
+{
+    for (unsigned long i = 0; i < ms; i++)
+    {
+        simTime_ms++;
+        plant->step(1, simTime_ms);
+    }
+}
+
+unsigned long millis() { return simTime_ms; }
+unsigned long micros() { return simTime_ms * 1000; }
+void delay(uint32_t ms) { advance(ms); }
+void delayMicroseconds(uint32_t) {}
+void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t pin) { return pin == PIN_IN1 ? pinIn1 : pin == PIN_IN2 ? pinIn2 : LOW; }
+uint32_t analogReadMilliVolts(uint8_t pin) { return analogRead(pin) * 3100 / 4095; }
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin == PIN_IN1)
+    {
+        pinIn1 = val;
+    }
+    else if (pin == PIN_IN2)
+    {
+        pinIn2 = val;
+    }
+    plant->setPins(pinIn1, pinIn2);
+}
+
+uint16_t analogRead(uint8_t pin)
+{
+    return pin == PIN_CURRENT_SENSE ? plant->readAdc() : 0;
+}
+
+// ----------------------------------------------------------------------------
+// Scenarios
+// ----------------------------------------------------------------------------
+
+struct Scenario
+{
+    std::string name;
+    bool raise;
+    DoorPlant::Parameters parameters;
+};
+
+struct Statistics
+{
+    int runs = 0;
+    int falseStops = 0;
+    int missed = 0;
+    int detected = 0;
+    unsigned long latencySum = 0;
+    unsigned long latencyMax = 0;
+    unsigned long overrunSum = 0;
+    unsigned long overrunMax = 0;
+    int stopReasons[5] = {};
+};
+
+static std::vector<Scenario> createScenarios()
+{
+    std::vector<Scenario> scenarios;
+    DoorPlant::Parameters nominal;
+    scenarios.push_back({"raise 4.5V", true, nominal});
+    scenarios.push_back({"lower 4.5V", false, nominal});
+
+    DoorPlant::Parameters fresh = nominal;
+    fresh.batteryVoltage_mV = 6200;
+    scenarios.push_back({"raise 6.2V", true, fresh});
+    scenarios.push_back({"lower 6.2V", false, fresh});
+
+    DoorPlant::Parameters looseRope = nominal;
+    looseRope.looseRope_ms = 3000;
+    scenarios.push_back({"raise loose rope", true, looseRope});
+
+    DoorPlant::Parameters jammed = nominal;
+    jammed.jamPosition = 0.4f;
+    scenarios.push_back({"raise jammed", true, jammed});
+    jammed.jamPosition = 0.6f;
+    scenarios.push_back({"lower jammed", false, jammed});
+
+    DoorPlant::Parameters sag = nominal;
+    sag.batteryVoltage_mV = 4300;
+    sag.sourceResistance_mOhm = 1500;
+    scenarios.push_back({"raise battery sag", true, sag});
+    scenarios.push_back({"lower battery sag", false, sag});
+
+    DoorPlant::Parameters noisy = nominal;
+    noisy.noise = 80;
+    scenarios.push_back({"raise noisy", true, noisy});
+    scenarios.push_back({"lower noisy", false, noisy});
+    return scenarios;
+}
+
+/**
+ * @brief Boot the firmware, run the motor once and evaluate the result.
+ */
+static void runOnce(const Scenario &scenario, uint32_t seed, unsigned long loopPeriod_ms, Statistics &statistics)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> spread(0.9f, 1.1f);
+    DoorPlant::Parameters parameters = scenario.parameters;
+    // Every door is a bit different
+    parameters.travelTime_ms *= spread(random);
+    parameters.liftCurrent *= spread(random);
+    parameters.lowerCurrent *= spread(random);
+
+    DoorPlant door(parameters, seed);
+    plant = &door;
+    simTime_ms = 0;
+    pinIn1 = pinIn2 = false;
+
+    // Same channels as the firmware, as they share the sample rate of the scan
+    AdcScanner adc;
+    adc.addChannel(PIN_BUTTON, 10);
+    adc.addChannel(PIN_VMOTOR, 100);
+    adc.addChannel(PIN_CURRENT_SENSE, MotorControl::ADC_PERIOD);
+    adc.begin();
+    MotorControl motor(PIN_IN1, PIN_IN2, adc, PIN_CURRENT_SENSE);
+    motor.init(door.getMotorVoltage_mV());
+    if (scenario.raise)
+    {
+        motor.openDoor();
+    }
+    else
+    {
+        motor.closeDoor();
+    }
+    unsigned long startTime = simTime_ms;
+    unsigned long stopDecisionTime = 0;
+    DoorPlant::Endpoint endpointAtStop = DoorPlant::Endpoint::None;
+    while (simTime_ms - startTime < MAX_RUN_TIME)
+    {
+        // The firmware reads the voltage from the ADC scanner, averaged over 100ms.  The plant voltage is close enough.
+        motor.setMotorVoltage(door.getMotorVoltage_mV());
+        if (!motor.run())
+        {
+            break;
+        }
+        if (stopDecisionTime == 0 && motor.getStopReason() != MotorControl::StopReason::None)
+        {
+            stopDecisionTime = simTime_ms;
+            endpointAtStop = door.getEndpoint();
+        }
+        advance(loopPeriod_ms);
+    }
+    unsigned long motorOffTime = simTime_ms;
+
+    statistics.runs++;
+    statistics.stopReasons[static_cast<int>(motor.getStopReason())]++;
+    if (endpointAtStop == DoorPlant::Endpoint::None)
+    {
+        statistics.falseStops++;
+        return;
+    }
+    if (motor.getStopReason() == MotorControl::StopReason::Timeout)
+    {
+        statistics.missed++;
+    }
+    unsigned long latency = stopDecisionTime - door.getEndpointTime();
+    unsigned long overrun = motorOffTime - door.getEndpointTime();
+    statistics.detected++;
+    statistics.latencySum += latency;
+    statistics.latencyMax = max(statistics.latencyMax, latency);
+    statistics.overrunSum += overrun;
+    statistics.overrunMax = max(statistics.overrunMax, overrun);
+}
+
+int main(int argc, char *argv[])
+{
+    int runCount = 20;
+    unsigned long loopPeriod_ms = 10;
+    std::string filter;
+    bool keepStatistics = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc)
+        {
+            runCount = atoi(argv[++i]);
+        }
+        else if (arg == "-l" && i + 1 < argc)
+        {
+            loopPeriod_ms = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "-s" && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (arg == "-k")
+        {
+            keepStatistics = true;
+        }
+        else if (arg == "-v")
+        {
+            simVerbose = true;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-n runs] [-l loop_period_ms] [-s scenario] [-k] [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%-20s %5s %10s %7s %15s %15s   %s\n", "scenario", "runs", "false-stop", "missed", "latency avg/max", "overrun avg/max",
+           "stop reasons (end/overload/timeout/no current)");
+    for (const Scenario &scenario : createScenarios())
+    {
+        if (scenario.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        if (!keepStatistics)
+        {
+            Preferences::clearAll();
+        }
+        Statistics statistics;
+        for (int i = 0; i < runCount; i++)
+        {
+            runOnce(scenario, 1000 + i, loopPeriod_ms, statistics);
+        }
+        int detected = max(statistics.detected, 1);
+        printf("%-20s %5d %9.0f%% %7d %7lu/%-7lu %7lu/%-7lu   %d/%d/%d/%d\n", scenario.name.c_str(), statistics.runs,
+               100.0 * statistics.falseStops / statistics.runs, statistics.missed,
+               statistics.latencySum / detected, statistics.latencyMax,
+               statistics.overrunSum / detected, statistics.overrunMax,
+               statistics.stopReasons[1], statistics.stopReasons[2], statistics.stopReasons[3], statistics.stopReasons[4]);
+    }
+    return 0;
+}
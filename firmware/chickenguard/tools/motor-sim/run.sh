@@ -0,0 +1,10 @@
+#!/bin/sh
+# Build the motor simulator for the host and run it.  Arguments are passed to the simulator, see main.cpp.
+set -e
+cd "$(dirname "$0")/../.."
+mkdir -p .pio/motor-sim
+g++ -std=gnu++17 -O2 -Wall -Itools/motor-sim/stubs -Itools/motor-sim -Iinclude \
+    tools/motor-sim/main.cpp tools/motor-sim/doorPlant.cpp tools/motor-sim/adcScanner.cpp \
+    src/motorControl.cpp src/motorCalibration.cpp src/motorTrace.cpp src/traceLog.cpp \
+    -o .pio/motor-sim/motor-sim
+.pio/motor-sim/motor-sim "$@"
@@ -0,0 +1,37 @@
+/**
+ * @brief Same behaviour as stevemarple/AsyncDelay, running on the simulation clock.
+ */
+#pragma once
+
+#include "Arduino.h"
+
+class AsyncDelay
+{
+public:
+    enum units_t
+    {
+        MICROS,
+        MILLIS
+    };
+    AsyncDelay() {}
+    AsyncDelay(unsigned long d, units_t unit) { start(d, unit); }
+    void start(unsigned long d, units_t unit)
+    {
+        _delay = d;
+        _unit = unit;
+        _expires = now() + d;
+    }
+    bool isExpired() const { return (long)(now() - _expires) >= 0; }
+    void expire() { _expires = now(); }
+    void repeat() { _expires += _delay; }
+    void restart() { _expires = now() + _delay; }
+    unsigned long getDelay() const { return _delay; }
+    unsigned long getExpiry() const { return _expires; }
+    units_t getUnit() const { return _unit; }
+
+private:
+    unsigned long now() const { return _unit == MILLIS ? millis() : micros(); }
+    unsigned long _delay = 0;
+    unsigned long _expires = 0;
+    units_t _unit = MICROS;
+};
@@ -0,0 +1,79 @@
+/**
+ * @brief In-memory replacement of the ESP32 Preferences (NVS) library.
+ * @details The contents survive between simulated boots, until Preferences::clearAll() is called.
+ */
+#pragma once
+
+#include "Arduino.h"
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false)
+    {
+        _namespace = name;
+        if (!readOnly)
+        {
+            return true;
+        }
+        // Like NVS, a namespace can't be opened read-only before anything has been written to it.
+        for (auto &entry : storage())
+        {
+            if (entry.first.rfind(_namespace + "/", 0) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    void end() {}
+    bool isKey(const char *key) { return storage().count(path(key)) != 0; }
+    bool remove(const char *key) { return storage().erase(path(key)) != 0; }
+    size_t getBytesLength(const char *key)
+    {
+        auto it = storage().find(path(key));
+        return it == storage().end() ? 0 : it->second.size();
+    }
+    size_t getBytes(const char *key, void *buf, size_t maxLen)
+    {
+        auto it = storage().find(path(key));
+        if (it == storage().end() || it->second.size() > maxLen)
+        {
+            return 0;
+        }
+        memcpy(buf, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+    size_t putBytes(const char *key, const void *value, size_t len)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(value);
+        storage()[path(key)].assign(bytes, bytes + len);
+        return len;
+    }
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putUChar(const char *key, uint8_t value) { return putBytes(key, &value, sizeof(value)); }
+    uint16_t getUShort(const char *key, uint16_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putUShort(const char *key, uint16_t value) { return putBytes(key, &value, sizeof(value)); }
+    uint32_t getULong(const char *key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putULong(const char *key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+
+    static void clearAll() { storage().clear(); }
+
+private:
+    template <typename T>
+    T get(const char *key, T defaultValue)
+    {
+        T value;
+        return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+    }
+    std::string path(const char *key) const { return _namespace + "/" + key; }
+    static std::map<std::string, std::vector<uint8_t>> &storage()
+    {
+        static std::map<std::string, std::vector<uint8_t>> nvs;
+        return nvs;
+    }
+    std::string _namespace;
+};
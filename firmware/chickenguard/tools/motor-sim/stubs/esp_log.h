@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdio.h>
+
+/**
+ * @brief Firmware logging is only printed when the simulator runs in verbose mode.
+ */
+extern bool simVerbose;
+
+#define SIM_LOG(letter, tag, format, ...)                                                       \
+    do                                                                                          \
+    {                                                                                           \
+        if (simVerbose)                                                                         \
+            printf("%8lu " letter " (%s) " format "\n", millis(), tag, ##__VA_ARGS__);          \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) SIM_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) SIM_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) SIM_LOG("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) SIM_LOG("D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) SIM_LOG("V", tag, format, ##__VA_ARGS__)
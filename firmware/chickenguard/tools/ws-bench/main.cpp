@@ -0,0 +1,147 @@
+/**
+ * @file main.cpp
+ * @brief Compares the JSON websocket messages with the binary messages of include/wsProtocol.h.
+ * @details Build and run on the host with tools/ws-bench/run.sh
+ *  The configuration is decoded the way Webservice::handleJsonMessage() and Webservice::handleBinaryMessage() do, the status is
+ *  encoded the way Webservice::flushStatus() does for both kinds of clients.  Needs ArduinoJson 6, as pinned in platformio.ini.  Heap allocations are counted with a replaced
+ *  operator new, the stack use is the size of the JSON document or of the message.
+ *  The host is much faster than the ESP32-C3, only the ratios are meaningful.
+ */
+#include "wsProtocol.h"
+#include "NonVolatileStorage.h"
+#include <ArduinoJson.h>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+size_t stringAllocations = 0;
+static const size_t ITERATIONS = 1000000;
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static const char CONFIG_JSON[] = "{\"UTCSeconds\":1760860800,\"Timezone\":\"Europe/Brussels\",\"Latitude\":50.85,\"Longitude\":4.35,"
+                                  "\"DoorControl\":\"fixedTime\",\"AutomaticOpeningTime\":\"07:30\",\"AutomaticClosingTime\":\"21:45\"}";
+
+static WsProtocol::Config createConfig()
+{
+    WsProtocol::Config config = {};
+    config.header = {static_cast<uint8_t>(WsProtocol::MessageType::Config), WsProtocol::VERSION};
+    config.doorControl = 1;
+    config.openHour = 7;
+    config.openMinute = 30;
+    config.closeHour = 21;
+    config.closeMinute = 45;
+    config.utc = 1760860800;
+    config.latitude = 50.85f;
+    config.longitude = 4.35f;
+    strncpy(config.timeZone, "Europe/Brussels", sizeof(config.timeZone));
+    return config;
+}
+
+template <typename Function>
+static void benchmark(const char *name, size_t messageSize, size_t stackSize, Function function)
+{
+    volatile uint32_t sink = 0;
+    size_t start = allocations;
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ITERATIONS; i++)
+    {
+        sink = sink + function();
+    }
+    auto stopTime = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(stopTime - startTime).count() / ITERATIONS;
+    printf("%-24s %8.1f ns/message %4zu bytes on the wire %4zu bytes of stack %6.1f allocations/message\n", name, ns, messageSize,
+           stackSize, (double)(allocations - start) / ITERATIONS);
+}
+
+int main()
+{
+    // The JSON parser writes into its input, so every iteration decodes a fresh copy, like a received frame
+    char message[sizeof(CONFIG_JSON)];
+    size_t jsonDocumentSize = sizeof(StaticJsonDocument<JSON_OBJECT_SIZE(7)>);
+    benchmark("Config, JSON decode", strlen(CONFIG_JSON), jsonDocumentSize, [&]() {
+        memcpy(message, CONFIG_JSON, sizeof(CONFIG_JSON));
+        StaticJsonDocument<JSON_OBJECT_SIZE(7)> json;
+        if (deserializeJson(json, message, strlen(CONFIG_JSON)))
+        {
+            return 0u;
+        }
+        const char *timeZone = json["Timezone"] | "";
+        NonVolatileStorage::DoorControl doorControl = NonVolatileStorage::DoorControl::Manual;
+        NonVolatileStorage::parseDoorControl(json["DoorControl"], doorControl);
+        uint8_t hour = 0;
+        uint8_t minutes = 0;
+        NonVolatileStorage::parseTimeString(json["AutomaticOpeningTime"], hour, minutes);
+        NonVolatileStorage::parseTimeString(json["AutomaticClosingTime"], hour, minutes);
+        return (unsigned)json["UTCSeconds"].as<long>() + (unsigned)(json["Latitude"].as<float>() * 100) + timeZone[0] +
+               static_cast<unsigned>(doorControl) + hour + minutes;
+    });
+
+    WsProtocol::Config config = createConfig();
+    uint8_t frame[sizeof(config)];
+    benchmark("Config, binary decode", sizeof(config), 0, [&]() {
+        memcpy(frame, &config, sizeof(config));
+        if (!WsProtocol::isMessage(frame, sizeof(frame), WsProtocol::MessageType::Config, sizeof(WsProtocol::Config)))
+        {
+            return 0u;
+        }
+        const WsProtocol::Config &received = *reinterpret_cast<const WsProtocol::Config *>(frame);
+        return (unsigned)received.utc + (unsigned)(received.latitude * 100) + received.timeZone[0] + received.doorControl +
+               received.openHour + received.openMinute;
+    });
+
+    // The two {"key", "status"} messages of the JSON clients
+    char buffer[80];
+    char text[48];
+    uint32_t freeHeap = 182340;
+    auto encodeJsonStatus = [&]() {
+        size_t length = 0;
+        StaticJsonDocument<JSON_OBJECT_SIZE(2)> battery;
+        snprintf(text, sizeof(text), "%u%%", 87u);
+        battery["key"] = "battery";
+        battery["status"] = text;
+        length += serializeJson(battery, buffer, sizeof(buffer));
+        StaticJsonDocument<JSON_OBJECT_SIZE(2)> heap;
+        snprintf(text, sizeof(text), "%lu bytes free, largest block %lu", (unsigned long)freeHeap++, 110580ul);
+        heap["key"] = "heap";
+        heap["status"] = text;
+        length += serializeJson(heap, buffer, sizeof(buffer));
+        return (unsigned)length;
+    };
+    benchmark("Status, JSON encode", encodeJsonStatus(), sizeof(StaticJsonDocument<JSON_OBJECT_SIZE(2)>) + sizeof(buffer) + sizeof(text),
+              encodeJsonStatus);
+
+    benchmark("Status, binary encode", sizeof(WsProtocol::Status), sizeof(WsProtocol::Status), [&]() {
+        WsProtocol::Status status;
+        status.header = {static_cast<uint8_t>(WsProtocol::MessageType::Status), WsProtocol::VERSION};
+        status.batteryPercent = 87;
+        status.reserved = 0;
+        status.freeHeap = freeHeap++;
+        status.largestBlock = 110580;
+        memcpy(buffer, &status, sizeof(status));
+        return (unsigned)buffer[4];
+    });
+    return 0;
+}
@@ -0,0 +1,14 @@
+#!/bin/sh
+# Build the websocket protocol benchmark for the host and run it.
+# ArduinoJson is taken from the PlatformIO library folder, so build the firmware once first.
+set -e
+cd "$(dirname "$0")/../.."
+ARDUINOJSON=$(ls -d .pio/libdeps/*/ArduinoJson/src 2>/dev/null | head -n 1)
+if [ -z "$ARDUINOJSON" ]; then
+    echo "ArduinoJson not found in .pio/libdeps, run 'pio run' first" >&2
+    exit 1
+fi
+mkdir -p .pio/ws-bench
+g++ -std=gnu++17 -O2 -Wall -Itools/alloc-count/stubs -Iinclude -I"$ARDUINOJSON" tools/ws-bench/main.cpp \
+    src/NonVolatileStorage.cpp -o .pio/ws-bench/ws-bench
+.pio/ws-bench/ws-bench
@@ -0,0 +1,227 @@
+/**
+ * @file main.cpp
+ * @brief Feeds WsReassembler with websocket messages split at random points, as AsyncWebSocket delivers them.
+ * @details Build and run on the host with tools/ws-fuzz/run.sh
+ *  Options :
+ *    -n <count>  : random messages (default 100000)
+ *    -s <seed>   : seed of the random generator (default 1)
+ *  Each message is split in frames (fragmentation), each frame in pieces (TCP segments).  Every split point of a configuration
+ *  message is tried, then random messages up to twice MAX_MESSAGE_SIZE with random split points.  Every message must come out
+ *  unchanged, once, or be reported once as TooLarge.  Pieces that don't follow each other must be reported as Malformed, without
+ *  affecting the next message.  The exit code is 1 when a check fails.
+ */
+#include "wsReassembler.h"
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+typedef WsReassembler::Result Result;
+
+struct Piece
+{
+    uint8_t opcode;
+    bool final;
+    uint64_t frameLength;
+    uint64_t index;
+    size_t offset; //!< in the message
+    size_t len;
+};
+
+static size_t failures = 0;
+
+static void check(bool condition, const char *what, size_t messageLength)
+{
+    if (!condition && failures++ < 10)
+    {
+        printf("FAILED : %s, message of %zu bytes\n", what, messageLength);
+    }
+}
+
+/**
+ * @brief Split a message in frames at the frame split points, and each frame in pieces at the piece split points
+ */
+static std::vector<Piece> split(uint8_t opcode, size_t length, std::vector<size_t> frameSplits, std::vector<size_t> pieceSplits)
+{
+    std::vector<Piece> pieces;
+    frameSplits.push_back(length);
+    size_t frameStart = 0;
+    for (size_t f = 0; f < frameSplits.size(); f++)
+    {
+        size_t frameEnd = frameSplits[f];
+        size_t pieceStart = frameStart;
+        for (size_t point : pieceSplits)
+        {
+            if (point > pieceStart && point < frameEnd)
+            {
+                pieces.push_back({f == 0 ? opcode : WsReassembler::OPCODE_CONTINUATION, f + 1 == frameSplits.size(),
+                                  frameEnd - frameStart, pieceStart - frameStart, pieceStart, point - pieceStart});
+                pieceStart = point;
+            }
+        }
+        pieces.push_back({f == 0 ? opcode : WsReassembler::OPCODE_CONTINUATION, f + 1 == frameSplits.size(), frameEnd - frameStart,
+                          pieceStart - frameStart, pieceStart, frameEnd - pieceStart});
+        frameStart = frameEnd;
+    }
+    return pieces;
+}
+
+/**
+ * @brief Feed the pieces of a message and check the outcome
+ */
+static void feedMessage(WsReassembler &reassembler, std::vector<uint8_t> message, uint8_t opcode, const std::vector<Piece> &pieces)
+{
+    const std::vector<uint8_t> original = message;
+    size_t completed = 0;
+    size_t tooLarge = 0;
+    bool others = false;
+    bool inPlace = false;
+    for (const Piece &piece : pieces)
+    {
+        switch (reassembler.feed(piece.opcode, piece.final, piece.frameLength, piece.index, message.data() + piece.offset, piece.len))
+        {
+        case Result::Complete:
+            completed++;
+            check(reassembler.getOpcode() == opcode, "opcode", message.size());
+            check(reassembler.getLength() == original.size() &&
+                      memcmp(reassembler.getMessage(), original.data(), original.size()) == 0,
+                  "content", message.size());
+            inPlace = reassembler.getMessage() == message.data() + piece.offset;
+            break;
+        case Result::TooLarge:
+            tooLarge++;
+            break;
+        case Result::Incomplete:
+            break;
+        case Result::Malformed:
+            others = true;
+            break;
+        }
+    }
+    check(!others, "no error", message.size());
+    // Empty frames may come before the piece holding the whole message
+    bool onePiece = pieces.back().len == message.size();
+    if (message.size() > WsReassembler::MAX_MESSAGE_SIZE && !onePiece)
+    {
+        check(completed == 0 && tooLarge == 1, "too large once", message.size());
+    }
+    else
+    {
+        check(completed == 1 && tooLarge == 0, "complete once", message.size());
+        check(inPlace == onePiece, "in place only when not split", message.size());
+    }
+}
+
+static std::vector<uint8_t> createMessage(std::mt19937 &random, size_t length)
+{
+    std::vector<uint8_t> message(length);
+    for (uint8_t &byte : message)
+    {
+        byte = random();
+    }
+    return message;
+}
+
+/**
+ * @brief Every split in two or three pieces, in one or two frames, of a binary configuration message
+ */
+static void exhaustiveSplits(WsReassembler &reassembler, std::mt19937 &random)
+{
+    const size_t length = 51;
+    std::vector<uint8_t> message = createMessage(random, length);
+    feedMessage(reassembler, message, WsReassembler::OPCODE_BINARY, split(WsReassembler::OPCODE_BINARY, length, {}, {}));
+    for (size_t first = 0; first <= length; first++)
+    {
+        for (size_t second = first; second <= length; second++)
+        {
+            feedMessage(reassembler, message, WsReassembler::OPCODE_BINARY,
+                        split(WsReassembler::OPCODE_BINARY, length, {}, {first, second}));
+            feedMessage(reassembler, message, WsReassembler::OPCODE_BINARY,
+                        split(WsReassembler::OPCODE_BINARY, length, {first}, {second}));
+        }
+    }
+}
+
+static void randomSplits(WsReassembler &reassembler, std::mt19937 &random, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t length = random() % (2 * WsReassembler::MAX_MESSAGE_SIZE + 1);
+        uint8_t opcode = random() % 2 ? WsReassembler::OPCODE_TEXT : WsReassembler::OPCODE_BINARY;
+        std::vector<size_t> frameSplits;
+        std::vector<size_t> pieceSplits;
+        for (size_t n = random() % 4; n > 0; n--)
+        {
+            frameSplits.push_back(random() % (length + 1));
+        }
+        for (size_t n = random() % 6; n > 0; n--)
+        {
+            pieceSplits.push_back(random() % (length + 1));
+        }
+        std::sort(frameSplits.begin(), frameSplits.end());
+        std::sort(pieceSplits.begin(), pieceSplits.end());
+        feedMessage(reassembler, createMessage(random, length), opcode, split(opcode, length, frameSplits, pieceSplits));
+    }
+}
+
+/**
+ * @brief Pieces that don't follow each other, each followed by a valid message
+ */
+static void malformedInput(WsReassembler &reassembler, std::mt19937 &random)
+{
+    uint8_t data[16] = {};
+    const uint8_t TEXT = WsReassembler::OPCODE_TEXT;
+    const uint8_t CONTINUATION = WsReassembler::OPCODE_CONTINUATION;
+    struct Case
+    {
+        const char *name;
+        std::vector<Piece> pieces;
+    };
+    const Case cases[] = {
+        {"continuation without a message", {{CONTINUATION, true, 4, 0, 0, 4}}},
+        {"piece without a frame", {{TEXT, true, 8, 4, 0, 4}}},
+        {"gap in a frame", {{TEXT, true, 12, 0, 0, 4}, {TEXT, true, 12, 8, 0, 4}}},
+        {"new frame before the end of a frame", {{TEXT, true, 8, 0, 0, 4}, {CONTINUATION, true, 4, 0, 0, 4}}},
+        {"new message in a message", {{TEXT, false, 4, 0, 0, 4}, {TEXT, true, 4, 0, 0, 4}}},
+        {"piece beyond the frame", {{TEXT, true, 4, 0, 0, 8}}},
+        {"frame length changed", {{TEXT, true, 8, 0, 0, 4}, {TEXT, true, 12, 4, 0, 4}}},
+        {"control frame", {{0x9, true, 4, 0, 0, 4}}},
+    };
+    for (const Case &test : cases)
+    {
+        bool malformed = false;
+        for (const Piece &piece : test.pieces)
+        {
+            malformed = reassembler.feed(piece.opcode, piece.final, piece.frameLength, piece.index, data, piece.len) == Result::Malformed;
+        }
+        check(malformed, test.name, 0);
+        std::vector<uint8_t> message = createMessage(random, 20);
+        feedMessage(reassembler, message, TEXT, split(TEXT, message.size(), {7}, {3, 15}));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = 100000;
+    unsigned seed = 1;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-n") == 0)
+        {
+            count = strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "-s") == 0)
+        {
+            seed = strtoul(argv[i + 1], nullptr, 10);
+        }
+    }
+    std::mt19937 random(seed);
+    WsReassembler reassembler;
+    exhaustiveSplits(reassembler, random);
+    randomSplits(reassembler, random, count);
+    malformedInput(reassembler, random);
+    printf("%s : %zu failures, seed %u\n", failures ? "FAILED" : "ok", failures, seed);
+    return failures ? 1 : 0;
+}
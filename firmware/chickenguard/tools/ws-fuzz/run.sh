@@ -0,0 +1,7 @@
+#!/bin/sh
+# Build the websocket reassembly fuzzer for the host and run it.  Arguments are passed to the fuzzer, see main.cpp.
+set -e
+cd "$(dirname "$0")/../.."
+mkdir -p .pio/ws-fuzz
+g++ -std=gnu++17 -O2 -Wall -Iinclude tools/ws-fuzz/main.cpp src/wsReassembler.cpp -o .pio/ws-fuzz/ws-fuzz
+.pio/ws-fuzz/ws-fuzz "$@"